@@ -13,21 +13,28 @@ varying vec3 norm;                  // [to fragment shader] vertex normal (in wo
 varying vec2 texcoord;              // [to fragment shader] vertex texture coordinate
 
 uniform bool skin_enabled;                  // skinning
-uniform mat4 skin_bone_xforms[48];          // bone xform
+uniform sampler2D skin_bone_xforms;         // bone xforms (the first three rows of bone i in texture row i)
+uniform float skin_bones_num;               // number of bones (texture rows)
 attribute vec4 vertex_skin_bone_ids;        // skin bone indices
 attribute vec4 vertex_skin_bone_weights;    // skin weights
 
+// row of a bone xform
+vec4 skin_bone_row(float idx, float row) {
+    return texture2DLod(skin_bone_xforms, vec2((row+0.5)/3.0, (idx+0.5)/skin_bones_num), 0.0);
+}
+
 // main function
 void main() {
     // apply skinning if necessary
     if(skin_enabled) {
         pos = vec3(0,0,0); norm = vec3(0,0,0);
         for (int i = 0; i < 4; i ++) {
-            int idx = int(vertex_skin_bone_ids[i]);
+            float idx = vertex_skin_bone_ids[i];
             float weight = vertex_skin_bone_weights[i];
-            if(idx >= 0) {
-                pos  += weight * (skin_bone_xforms[idx] * vec4(vertex_pos, 1)).xyz;
-                norm += weight * (skin_bone_xforms[idx] * vec4(vertex_norm,0)).xyz;
+            if(idx >= 0.0) {
+                vec4 x = skin_bone_row(idx, 0.0), y = skin_bone_row(idx, 1.0), z = skin_bone_row(idx, 2.0);
+                pos  += weight * vec3(dot(x, vec4(vertex_pos,1)), dot(y, vec4(vertex_pos,1)), dot(z, vec4(vertex_pos,1)));
+                norm += weight * vec3(dot(x.xyz, vertex_norm), dot(y.xyz, vertex_norm), dot(z.xyz, vertex_norm));
             }
         }
         norm = normalize(norm);
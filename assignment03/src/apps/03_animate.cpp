@@ -11,7 +11,12 @@ void uiloop();
 
 string scene_filename;          // scene filename
 string image_filename;          // image filename
+string video_filename;          // video stream of captured frames ("" for numbered pngs, "-" for stdout)
+bool headless = false;          // render and capture all animation frames with a hidden window, then exit
+bool skinning_gpu = false;      // skinning on the gpu
 Scene* scene;                   // scene
+SceneWatch* scene_watch = nullptr;  // scene files watched for changes (nullptr if not watching)
+int animation_step = 0;         // incremented whenever animated meshes may have moved (to stream them to the gpu)
 
 
 // get keyframe interval that contains time 1)
@@ -91,20 +96,23 @@ void animate_frame(Scene* scene) {
     for (auto surface: scene->surfaces) {
         // if not animation, continue
         if (surface->animation  == nullptr) continue;
-            // call animate_compute_frame and update surface frame
+            // call animate_compute_frame and update surface frame (display meshes are drawn with it)
             surface->frame = animate_compute_frame(surface->animation, scene->animation->time);
-            // update the _display_mesh frame if exists
-            if (surface->_display_mesh != nullptr) surface->_display_mesh->frame = animate_compute_frame(surface->animation, scene->animation->time);
     }
 }
 
 // skinning scene 4)
-void animate_skin(Scene* scene) {
+// subdivided meshes are always skinned on the cpu since the gpu only draws their display mesh
+void animate_skin(Scene* scene, bool skinning_gpu) {
     
     // foreach mesh
      for (auto mesh : scene->meshes) {
         // if no skinning, continue
         if (mesh->skinning  == nullptr) continue;
+        // if skinned on the gpu, continue
+        if (skinning_gpu and not mesh->_display_mesh) continue;
+        // bone xforms of the current frame
+        auto& bone_xforms = get_bone_xforms(mesh->skinning, scene->animation->time);
 
         // foreach vertex index
         for (int i = 0; i < mesh->pos.size(); i++) {
@@ -120,7 +128,7 @@ void animate_skin(Scene* scene) {
                 // if index < 0, continue
                 if (idx < 0) continue;
                 // grab bone xform
-                auto matrix = mesh->skinning->bone_xforms[scene->animation->time][idx];
+                auto matrix = bone_xforms[idx];
 
                 // accumulate weighted and transformed rest position and normal
                 auto newpoint = transform_point(matrix, mesh->skinning->rest_pos[i]);
@@ -300,32 +308,39 @@ void simulate(Scene* scene) {
         if ((!mesh->triangle.empty()) || (!mesh->quad.empty())) smooth_normals(mesh);
     }
 }
+// mesh reset
+void animate_reset(Mesh* mesh) {
+    if(mesh->animation) {
+        mesh->frame = mesh->animation->rest_frame;
+    }
+    if(mesh->skinning) {
+        mesh->pos = mesh->skinning->rest_pos;
+        mesh->norm = mesh->skinning->rest_norm;
+    }
+    if(mesh->simulation) {
+        mesh->pos = mesh->simulation->init_pos;
+        mesh->simulation->vel = mesh->simulation->init_vel;
+        mesh->simulation->force.resize(mesh->simulation->init_pos.size());
+    }
+}
+
 // scene reset
 void animate_reset(Scene* scene) {
+    animation_step ++;
     scene->animation->time = 0;
-    for(auto mesh : scene->meshes) {
-        if(mesh->animation) {
-            mesh->frame = mesh->animation->rest_frame;
-        }
-        if(mesh->skinning) {
-            mesh->pos = mesh->skinning->rest_pos;
-            mesh->norm = mesh->skinning->rest_norm;
-        }
-        if(mesh->simulation) {
-            mesh->pos = mesh->simulation->init_pos;
-            mesh->simulation->vel = mesh->simulation->init_vel;
-            mesh->simulation->force.resize(mesh->simulation->init_pos.size());
-        }
-    }
+    for(auto mesh : scene->meshes) animate_reset(mesh);
+    subdivide_update(scene);
 }
 
 // scene update
 void animate_update(Scene* scene, bool skinning_gpu) {
+    animation_step ++;
     scene->animation->time ++;
     if(scene->animation->time >= scene->animation->length) animate_reset(scene);
     animate_frame(scene);
-    if(not skinning_gpu) animate_skin(scene);
+    animate_skin(scene, skinning_gpu);
     simulate(scene);
+    subdivide_update(scene);
 }
 
 
@@ -335,11 +350,20 @@ void animate_update(Scene* scene, bool skinning_gpu) {
 int main(int argc, char** argv) {
     auto args = parse_cmdline(argc, argv,
         { "03_animate", "view scene",
-            {  {"resolution", "r", "image resolution", typeid(int), true, jsonvalue() }  },
+            {  {"resolution", "r", "image resolution", typeid(int), true, jsonvalue() },
+               {"cache", "c", "asset cache directory (parsed and subdivided meshes)", typeid(string), true, jsonvalue("") },
+               {"watch", "w", "reload the changed parts of the scene when its files change", typeid(bool), true, jsonvalue(false) },
+               {"video", "v", "stream captured frames as y4m (raw rgb for .rgb, - for stdout)", typeid(string), true, jsonvalue("") },
+               {"headless", "H", "capture all animation frames with a hidden window and exit", typeid(bool), true, jsonvalue(false) },
+               {"half_textures", "t", "store hdr (pfm) textures as half floats", typeid(bool), true, jsonvalue(false) },
+               {"gpu_skinning", "g", "skin meshes on the gpu", typeid(bool), true, jsonvalue(false) }  },
             {  {"scene_filename", "", "scene filename", typeid(string), false, jsonvalue("scene.json")},
                {"image_filename", "", "image filename", typeid(string), true, jsonvalue("")}  }
         });
     
+    set_asset_cache(args.object_element("cache").as_string());
+    set_texture_half_float(args.object_element("half_textures").as_bool());
+    
     // generate/load scene either by creating a test scene or loading from json file
     scene_filename = args.object_element("scene_filename").as_string();
     scene = nullptr;
@@ -347,6 +371,9 @@ int main(int argc, char** argv) {
         int scene_type = atoi(scene_filename.substr(9).c_str());
         scene = create_test_scene(scene_type);
         scene_filename = scene_filename + ".json";
+    } else if(args.object_element("watch").as_bool()) {
+        scene_watch = new SceneWatch();
+        scene = load_json_scene(scene_filename, scene_watch);
     } else {
         scene = load_json_scene(scene_filename);
     }
@@ -356,6 +383,10 @@ int main(int argc, char** argv) {
         args.object_element("image_filename").as_string() :
         scene_filename.substr(0,scene_filename.size()-5)+".png";
     
+    video_filename = args.object_element("video").as_string();
+    headless = args.object_element("headless").as_bool();
+    skinning_gpu = args.object_element("gpu_skinning").as_bool();
+    
     if(not args.object_element("resolution").is_null()) {
         scene->image_height = args.object_element("resolution").as_int();
         scene->image_width = scene->camera->width * scene->image_height / scene->camera->height;
@@ -384,12 +415,76 @@ bool draw_points  = true;       // draw points of mesh
 bool draw_edges   = false;      // draw edges of mesh
 bool draw_normals = false;      // draw normals
 
-bool skinning_gpu = false;      // skinning on the gpu    NOTE: NOT USED!
+bool capture = false;           // save each animated frame (as a numbered png or to the video stream)
+int capture_time = -1;          // animation time of the last captured frame
+ImageWriter* capture_writer = nullptr;  // writes captured frames in the background
+VideoWriter* capture_video = nullptr;   // video stream of captured frames
 
 int gl_program_id = 0;          // OpenGL program handle
 int gl_vertex_shader_id = 0;    // OpenGL vertex shader handle
 int gl_fragment_shader_id = 0;  // OpenGL fragment shader handle
-map<image3f*,int> gl_texture_id;// OpenGL texture handles
+map<Texture*,int> gl_texture_id;// OpenGL texture handles
+
+// locations of the program uniforms and attributes, looked up once after linking
+// (-1 for the ones not used by the shaders)
+struct GLLocations {
+    int camera_pos;                 // camera position
+    int camera_frame_inverse;       // inverse of the camera frame
+    int camera_projection;          // camera projection
+    int ambient;                    // ambient illumination
+    int lights_num;                 // number of lights
+    int light_pos;                  // light positions (first element of the array)
+    int light_intensity;            // light intensities (first element of the array)
+    int material_kd;                // material diffuse coefficient
+    int material_ks;                // material specular coefficient
+    int material_n;                 // material specular exponent
+    int material_is_lines;          // whether the material is lines or meshes
+    int material_double_sided;      // whether the material is double sided
+    int material_kd_txt;            // diffuse texture sampler
+    int material_kd_txt_on;         // diffuse texture enabled
+    int material_ks_txt;            // specular texture sampler
+    int material_ks_txt_on;         // specular texture enabled
+    int material_norm_txt;          // normal texture sampler
+    int material_norm_txt_on;       // normal texture enabled
+    int mesh_frame;                 // mesh frame
+    int skin_enabled;               // whether skinning is done on the gpu
+    int skin_bone_xforms;           // bone xforms texture sampler
+    int skin_bones_num;             // number of bones in the texture
+    int vertex_pos;                 // vertex position attribute
+    int vertex_norm;                // vertex normal attribute
+    int vertex_texcoord;            // vertex texture coordinate attribute
+    int vertex_skin_bone_ids;       // vertex skin bone ids attribute
+    int vertex_skin_bone_weights;   // vertex skin bone weights attribute
+};
+GLLocations gl_locations;       // OpenGL program locations
+bool gl_skinning_supported = false; // whether the vertex shader can read bone xforms from float textures
+
+// offscreen framebuffers of headless runs, since the contents of a hidden window are undefined
+unsigned int gl_capture_fbo = 0;            // framebuffer drawn into (0 to draw to the window)
+unsigned int gl_capture_resolve_fbo = 0;    // single sample framebuffer the drawn one is resolved to (0 if not multisampled)
+
+// maximum number of lights in the shader
+const int shader_max_lights = 16;
+
+// OpenGL buffers of a mesh: static meshes are uploaded once, while the positions and normals
+// of deforming meshes are streamed again, in orphaned buffers, when the animation moves them
+struct GLMesh {
+    unsigned int    pos_bid = 0;            // positions buffer
+    unsigned int    norm_bid = 0;           // normals buffer (0 if none)
+    unsigned int    texcoord_bid = 0;       // texture coordinates buffer (0 if none)
+    unsigned int    bone_ids_bid = 0;       // skin bone ids buffer, as floats (0 if not skinned)
+    unsigned int    bone_weights_bid = 0;   // skin bone weights buffer (0 if not skinned)
+    unsigned int    bone_xforms_tid = 0;    // skin bone xforms texture (0 if not skinned on the gpu)
+    int             bone_xforms_step = -1;  // animation step of the bone xforms in the texture
+    int             bones = 0;              // number of bones in the texture
+    unsigned int    elements_bid = 0;       // indices of all primitives, one kind after the other
+    vec2i           triangles, points, lines;   // (offset,count) of the indices of each kind
+    unsigned int    edges_bid = 0;          // indices of the unique face edges (built when first drawn)
+    int             edges = 0;              // number of edge indices
+    bool            dynamic = false;        // whether positions and normals are streamed
+    int             step = -1;              // animation step of the streamed positions and normals
+};
+map<Mesh*,GLMesh> gl_meshes;    // OpenGL buffers of the drawn meshes
 
 // initialize the shaders
 void init_shaders() {
@@ -427,8 +522,8 @@ void init_shaders() {
     glBindAttribLocation(gl_program_id, 0, "vertex_pos");
     glBindAttribLocation(gl_program_id, 1, "vertex_norm");
     glBindAttribLocation(gl_program_id, 2, "vertex_texcoord");
-    glBindAttribLocation(gl_program_id, 3, "vertex_skin_bones");
-    glBindAttribLocation(gl_program_id, 4, "vertex_skin_weights");
+    glBindAttribLocation(gl_program_id, 3, "vertex_skin_bone_ids");
+    glBindAttribLocation(gl_program_id, 4, "vertex_skin_bone_weights");
 
     // link program
     glLinkProgram(gl_program_id);
@@ -436,6 +531,47 @@ void init_shaders() {
     // check if program is valid
     error_if_glerror();
     error_if_program_not_valid(gl_program_id);
+    
+    // look up the uniform and attribute locations
+    auto uniform = [](const char* name) { return glGetUniformLocation(gl_program_id, name); };
+    auto attribute = [](const char* name) { return glGetAttribLocation(gl_program_id, name); };
+    auto& loc = gl_locations;
+    loc.camera_pos = uniform("camera_pos");
+    loc.camera_frame_inverse = uniform("camera_frame_inverse");
+    loc.camera_projection = uniform("camera_projection");
+    loc.ambient = uniform("ambient");
+    loc.lights_num = uniform("lights_num");
+    loc.light_pos = uniform("light_pos");
+    loc.light_intensity = uniform("light_intensity");
+    loc.material_kd = uniform("material_kd");
+    loc.material_ks = uniform("material_ks");
+    loc.material_n = uniform("material_n");
+    loc.material_is_lines = uniform("material_is_lines");
+    loc.material_double_sided = uniform("material_double_sided");
+    loc.material_kd_txt = uniform("material_kd_txt");
+    loc.material_kd_txt_on = uniform("material_kd_txt_on");
+    loc.material_ks_txt = uniform("material_ks_txt");
+    loc.material_ks_txt_on = uniform("material_ks_txt_on");
+    loc.material_norm_txt = uniform("material_norm_txt");
+    loc.material_norm_txt_on = uniform("material_norm_txt_on");
+    loc.mesh_frame = uniform("mesh_frame");
+    loc.skin_enabled = uniform("skin_enabled");
+    loc.skin_bone_xforms = uniform("skin_bone_xforms");
+    loc.skin_bones_num = uniform("skin_bones_num");
+    loc.vertex_pos = attribute("vertex_pos");
+    loc.vertex_norm = attribute("vertex_norm");
+    loc.vertex_texcoord = attribute("vertex_texcoord");
+    loc.vertex_skin_bone_ids = attribute("vertex_skin_bone_ids");
+    loc.vertex_skin_bone_weights = attribute("vertex_skin_bone_weights");
+    
+    // gpu skinning reads the bone xforms from a float texture in the vertex shader
+    auto vertex_texture_units = 0;
+    glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertex_texture_units);
+    gl_skinning_supported = GLEW_ARB_texture_float and vertex_texture_units > 0;
+    if(skinning_gpu and not gl_skinning_supported) {
+        message("gpu skinning is not supported: skinning on the cpu\n");
+        skinning_gpu = false;
+    }
 }
 
 // initialize the textures
@@ -456,30 +592,253 @@ void init_textures(Scene* scene) {
         // set texture filtering parameters
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-        // load texture data
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-                     texture->width(), texture->height(),
-                     0, GL_RGB, GL_FLOAT, texture->data());
+        // load the precomputed mip levels in their storage format
+        for(auto l : range(texture->levels())) {
+            auto w = texture->level_width(l), h = texture->level_height(l);
+            auto data = texture->level_data(l);
+            if(texture->format == texture_rgba8) {
+                glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+            } else if(texture->format == texture_rgb16f and GLEW_ARB_half_float_pixel) {
+                // half-float rows are 2-byte aligned
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+                glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, h, 0, GL_RGB, GL_HALF_FLOAT_ARB, data.data());
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            } else if(texture->format == texture_rgb16f) {
+                // no half-float uploads: convert to floats
+                auto values = vector<float>(data.size()/2);
+                for(auto i : range((int)values.size())) values[i] = half_to_float(((uint16_t*)data.data())[i]);
+                glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, h, 0, GL_RGB, GL_FLOAT, values.data());
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, h, 0, GL_RGB, GL_FLOAT, data.data());
+            }
+        }
+    }
+}
+
+// create or fill a buffer with an array (streamed buffers are orphaned first, so that the
+// driver does not wait for draws still reading the previous contents)
+template<typename T>
+void _upload_buffer(unsigned int& bid, unsigned int target, const vector<T>& values, bool stream) {
+    if(values.empty()) return;
+    if(not bid) glGenBuffers(1, &bid);
+    glBindBuffer(target, bid);
+    auto size = values.size()*sizeof(T);
+    if(stream) {
+        glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(target, 0, size, values.data());
+    } else glBufferData(target, size, values.data(), GL_STATIC_DRAW);
+}
+
+// append the indices of one kind of primitive to the element array, returning its (offset,count)
+template<typename T>
+vec2i _append_elements(vector<int>& elements, const vector<T>& primitives) {
+    auto span = vec2i(elements.size(), primitives.size()*sizeof(T)/sizeof(int));
+    auto values = (const int*)primitives.data();
+    elements.insert(elements.end(), values, values + span.y);
+    return span;
+}
+
+// buffers of a mesh, uploading them the first time and streaming positions and normals of
+// dynamic meshes when the animation moved them
+GLMesh& update_gl_mesh(Mesh* mesh, bool dynamic) {
+    auto& glmesh = gl_meshes[mesh];
+    if(not glmesh.pos_bid) {
+        glmesh.dynamic = dynamic;
+        _upload_buffer(glmesh.pos_bid, GL_ARRAY_BUFFER, mesh->pos, dynamic);
+        _upload_buffer(glmesh.norm_bid, GL_ARRAY_BUFFER, mesh->norm, dynamic);
+        _upload_buffer(glmesh.texcoord_bid, GL_ARRAY_BUFFER, mesh->texcoord, false);
+        if(mesh->skinning) {
+            // ids are floats since glsl 1.20 has no integer attributes
+            auto bone_ids = vector<vec4f>(mesh->skinning->bone_ids.size());
+            for(auto i : range((int)bone_ids.size())) for(auto j : range(4)) bone_ids[i][j] = mesh->skinning->bone_ids[i][j];
+            _upload_buffer(glmesh.bone_ids_bid, GL_ARRAY_BUFFER, bone_ids, false);
+            _upload_buffer(glmesh.bone_weights_bid, GL_ARRAY_BUFFER, mesh->skinning->bone_weights, false);
+        }
+        // quads are split in triangles, drawn in an order that reuses the vertex cache,
+        // and spline control polygons are drawn as lines together with the other lines
+        auto triangles = mesh->triangle;
+        auto quad_triangles = triangulate_quads(mesh->quad);
+        triangles.insert(triangles.end(), quad_triangles.begin(), quad_triangles.end());
+        auto lines = mesh->line;
+        for(auto s : mesh->spline) { lines.push_back({s.x,s.y}); lines.push_back({s.y,s.z}); lines.push_back({s.z,s.w}); }
+        auto elements = vector<int>();
+        glmesh.triangles = _append_elements(elements, optimize_triangle_order(triangles));
+        glmesh.points = _append_elements(elements, mesh->point);
+        glmesh.lines = _append_elements(elements, lines);
+        _upload_buffer(glmesh.elements_bid, GL_ELEMENT_ARRAY_BUFFER, elements, false);
+        glmesh.step = animation_step;
+    } else if((glmesh.dynamic or dynamic) and glmesh.step != animation_step) {
+        // (meshes that stop being dynamic, e.g. when skinning moves to the gpu, are uploaded once more)
+        glmesh.dynamic = dynamic;
+        _upload_buffer(glmesh.pos_bid, GL_ARRAY_BUFFER, mesh->pos, dynamic);
+        _upload_buffer(glmesh.norm_bid, GL_ARRAY_BUFFER, mesh->norm, dynamic);
+        glmesh.step = animation_step;
+    }
+    return glmesh;
+}
+
+// bone xforms texture of a skinned mesh, holding the first three rows of each bone xform
+// (the last is always (0,0,0,1)) in a texture row; uploaded at most once per animation step
+void update_gl_mesh_bones(Mesh* mesh, GLMesh& glmesh, int time) {
+    if(glmesh.bone_xforms_tid and glmesh.bone_xforms_step == animation_step) {
+        glBindTexture(GL_TEXTURE_2D, glmesh.bone_xforms_tid);
+        return;
+    }
+    auto& bone_xforms = get_bone_xforms(mesh->skinning, time);
+    auto rows = vector<vec4f>(bone_xforms.size()*3);
+    for(auto b : range((int)bone_xforms.size())) {
+        rows[b*3+0] = bone_xforms[b].x;
+        rows[b*3+1] = bone_xforms[b].y;
+        rows[b*3+2] = bone_xforms[b].z;
+    }
+    if(not glmesh.bone_xforms_tid or glmesh.bones != (int)bone_xforms.size()) {
+        if(not glmesh.bone_xforms_tid) glGenTextures(1, &glmesh.bone_xforms_tid);
+        glBindTexture(GL_TEXTURE_2D, glmesh.bone_xforms_tid);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, 3, bone_xforms.size(), 0, GL_RGBA, GL_FLOAT, rows.data());
+        glmesh.bones = bone_xforms.size();
+    } else {
+        glBindTexture(GL_TEXTURE_2D, glmesh.bone_xforms_tid);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 3, bone_xforms.size(), GL_RGBA, GL_FLOAT, rows.data());
+    }
+    glmesh.bone_xforms_step = animation_step;
+}
+
+// edge buffer of a mesh, built from its faces the first time edges are drawn; since topology
+// only changes when a mesh is reloaded, which deletes its buffers, it is never rebuilt otherwise
+void update_gl_mesh_edges(Mesh* mesh, GLMesh& glmesh) {
+    if(glmesh.edges_bid or (mesh->triangle.empty() and mesh->quad.empty())) return;
+    auto edges = EdgeMap(mesh->triangle, mesh->quad).edges();
+    glmesh.edges = edges.size()*2;
+    _upload_buffer(glmesh.edges_bid, GL_ELEMENT_ARRAY_BUFFER, edges, false);
+}
+
+// delete the buffers of a mesh
+void delete_gl_mesh(GLMesh& glmesh) {
+    for(auto bid : {glmesh.pos_bid, glmesh.norm_bid, glmesh.texcoord_bid, glmesh.bone_ids_bid, glmesh.bone_weights_bid, glmesh.elements_bid, glmesh.edges_bid}) {
+        if(bid) glDeleteBuffers(1, &bid);
+    }
+    if(glmesh.bone_xforms_tid) glDeleteTextures(1, &glmesh.bone_xforms_tid);
+    glmesh = GLMesh();
+}
+
+// reload the changed parts of the scene, then subdivide and upload only what was replaced
+void reload_scene(Scene* scene) {
+    auto reload = SceneReload();
+    if(not reload_json_scene(scene, scene_watch, reload)) return;
+    // drop the gl textures that were decoded again or are no longer used (their images may be freed)
+    auto textures = get_textures(scene);
+    for(auto it = gl_texture_id.begin(); it != gl_texture_id.end(); ) {
+        auto used = std::find(textures.begin(), textures.end(), it->first) != textures.end();
+        auto reloaded = std::find(reload.textures.begin(), reload.textures.end(), it->first) != reload.textures.end();
+        if(used and not reloaded) { ++it; continue; }
+        auto id = (unsigned int)it->second;
+        glDeleteTextures(1, &id);
+        it = gl_texture_id.erase(it);
+    }
+    init_textures(scene);
+    // new meshes start from their initial state, then all are brought to the current time
+    for(auto mesh : reload.meshes_reset) animate_reset(mesh);
+    for(auto mesh : reload.meshes) subdivide(mesh, scene->camera);
+    for(auto surface : reload.surfaces) subdivide_surface(surface);
+    animation_step ++;
+    animate_frame(scene);
+    animate_skin(scene, skinning_gpu);
+    subdivide_update(scene);
+    // drop the gl buffers of the meshes that were parsed or subdivided again or are no longer drawn
+    // (their memory may be freed or reused by new meshes)
+    auto drawn = set<Mesh*>(), reloaded = set<Mesh*>();
+    for(auto mesh : scene->meshes) { drawn.insert(mesh); drawn.insert(mesh->_display_mesh); }
+    for(auto surface : scene->surfaces) drawn.insert(surface->_display_mesh);
+    for(auto mesh : reload.meshes) { reloaded.insert(mesh); reloaded.insert(mesh->_display_mesh); }
+    for(auto surface : reload.surfaces) reloaded.insert(surface->_display_mesh);
+    for(auto it = gl_meshes.begin(); it != gl_meshes.end(); ) {
+        if(drawn.count(it->first) and not reloaded.count(it->first)) { ++it; continue; }
+        delete_gl_mesh(it->second);
+        it = gl_meshes.erase(it);
+    }
+    message("reloaded %s\n", scene_filename.c_str());
+}
+
+// create a framebuffer with color and depth renderbuffers (multisampled if samples > 1)
+unsigned int _make_framebuffer(int width, int height, int samples, bool depth) {
+    auto fbo = 0u, color = 0u, depth_rb = 0u;
+    glGenFramebuffersEXT(1, &fbo);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
+    glGenRenderbuffersEXT(1, &color);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, color);
+    if(samples > 1) glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER_EXT, samples, GL_RGBA8, width, height);
+    else glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, width, height);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, color);
+    if(depth) {
+        glGenRenderbuffersEXT(1, &depth_rb);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depth_rb);
+        if(samples > 1) glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER_EXT, samples, GL_DEPTH_COMPONENT24, width, height);
+        else glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depth_rb);
+    }
+    error_if_not(glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT, "incomplete offscreen framebuffer\n");
+    return fbo;
+}
+
+// set up the offscreen framebuffers of headless runs, at the scene image size
+void init_capture_framebuffer(Scene* scene) {
+    error_if_not(GLEW_EXT_framebuffer_object, "headless runs require framebuffer objects\n");
+    auto samples = scene->image_samples;
+    if(samples > 1 and not (GLEW_EXT_framebuffer_multisample and GLEW_EXT_framebuffer_blit)) {
+        message("multisampled framebuffers are not supported: capturing without multisampling\n");
+        samples = 1;
+    }
+    if(samples > 1) gl_capture_resolve_fbo = _make_framebuffer(scene->image_width, scene->image_height, 1, false);
+    gl_capture_fbo = _make_framebuffer(scene->image_width, scene->image_height, samples, true);
+}
+
+// read back the drawn frame and save it to the video stream, if any, or as a numbered png
+void capture_frame(Scene* scene) {
+    capture_time = scene->animation->time;
+    auto image = image3f(scene->image_width,scene->image_height);
+    if(gl_capture_resolve_fbo) {
+        // resolve the multisampled frame, then read it back
+        glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, gl_capture_fbo);
+        glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, gl_capture_resolve_fbo);
+        glBlitFramebufferEXT(0, 0, scene->image_width, scene->image_height, 0, 0, scene->image_width, scene->image_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, gl_capture_resolve_fbo);
+    }
+    glReadPixels(0, 0, scene->image_width, scene->image_height, GL_RGB, GL_FLOAT, &image.at(0,0));
+    if(gl_capture_resolve_fbo) glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, gl_capture_fbo);
+    if(video_filename != "") {
+        auto y4m = video_filename.size() < 4 or video_filename.substr(video_filename.size()-4) != ".rgb";
+        if(not capture_video) capture_video = new VideoWriter(video_filename, image.width(), image.height(), 1/scene->animation->dt, y4m);
+        // the stream has a fixed size, so frames drawn after resizing the window are skipped
+        if(image.width() == capture_video->_width and image.height() == capture_video->_height) capture_video->write_frame(image, true);
+        else message("skipped frame %d: size differs from the video stream\n", capture_time);
+    } else {
+        // frames are encoded while the next ones are simulated
+        if(not capture_writer) capture_writer = new ImageWriter();
+        auto filename = tostring("%s.%04d.png", image_filename.substr(0,image_filename.size()-4).c_str(), capture_time);
+        capture_writer->write_png(filename, std::move(image), true, true);
     }
 }
 
 // utility to bind texture parameters for shaders
-// uses texture name, texture_on name, texture pointer and texture unit position
-void _bind_texture(string name_map, string name_on, image3f* txt, int pos) {
+// uses texture location, texture_on location, texture pointer and texture unit position
+void _bind_texture(int location_map, int location_on, Texture* txt, int pos) {
     // if txt is not null
     if(txt) {
         // set texture on boolean parameter to true
-        glUniform1i(glGetUniformLocation(gl_program_id,name_on.c_str()),GL_TRUE);
+        glUniform1i(location_on,GL_TRUE);
         // activate a texture unit at position pos
         glActiveTexture(GL_TEXTURE0+pos);
         // bind texture object to it from gl_texture_id map
         glBindTexture(GL_TEXTURE_2D, gl_texture_id[txt]);
         // set texture parameter to the position pos
-        glUniform1i(glGetUniformLocation(gl_program_id, name_map.c_str()), pos);
+        glUniform1i(location_map, pos);
     } else {
         // set texture on boolean parameter to false
-        glUniform1i(glGetUniformLocation(gl_program_id,name_on.c_str()),GL_FALSE);
+        glUniform1i(location_on,GL_FALSE);
         // activate a texture unit at position pos
         glActiveTexture(GL_TEXTURE0+pos);
         // set zero as the texture id
@@ -487,100 +846,115 @@ void _bind_texture(string name_map, string name_on, image3f* txt, int pos) {
     }
 }
 
-// shade a mesh
-void shade_mesh(Mesh* mesh, int time) {
+// shade a mesh with a material and a transform (as a matrix)
+// (dynamic meshes have their positions and normals streamed when the animation moves them)
+void shade_mesh(Mesh* mesh, Material* mat, const mat4f& xform, int time, bool dynamic) {
     // bind material kd, ks, n
-    glUniform3fv(glGetUniformLocation(gl_program_id,"material_kd"),
-                 1,&mesh->mat->kd.x);
-    glUniform3fv(glGetUniformLocation(gl_program_id,"material_ks"),
-                 1,&mesh->mat->ks.x);
-    glUniform1f(glGetUniformLocation(gl_program_id,"material_n"),
-                mesh->mat->n);
-    glUniform1i(glGetUniformLocation(gl_program_id,"material_is_lines"),
-                GL_FALSE);
-    glUniform1i(glGetUniformLocation(gl_program_id,"material_double_sided"),
-                (mesh->mat->double_sided)?GL_TRUE:GL_FALSE);
+    auto& loc = gl_locations;
+    glUniform3fv(loc.material_kd,1,&mat->kd.x);
+    glUniform3fv(loc.material_ks,1,&mat->ks.x);
+    glUniform1f(loc.material_n,mat->n);
+    glUniform1i(loc.material_is_lines,GL_FALSE);
+    glUniform1i(loc.material_double_sided,(mat->double_sided)?GL_TRUE:GL_FALSE);
     // bind texture params (txt_on, sampler)
-    _bind_texture("material_kd_txt", "material_kd_txt_on", mesh->mat->kd_txt, 0);
-    _bind_texture("material_ks_txt", "material_ks_txt_on", mesh->mat->ks_txt, 1);
-    _bind_texture("material_norm_txt", "material_norm_txt_on", mesh->mat->norm_txt, 2);
+    _bind_texture(loc.material_kd_txt, loc.material_kd_txt_on, mat->kd_txt, 0);
+    _bind_texture(loc.material_ks_txt, loc.material_ks_txt_on, mat->ks_txt, 1);
+    _bind_texture(loc.material_norm_txt, loc.material_norm_txt_on, mat->norm_txt, 2);
+    
+    // bind mesh transform
+    glUniformMatrix4fv(loc.mesh_frame,1,true,&xform.x.x);
     
-    // bind mesh frame - use frame_to_matrix
-    glUniformMatrix4fv(glGetUniformLocation(gl_program_id,"mesh_frame"),
-                       1,true,&frame_to_matrix(mesh->frame)[0][0]);
+    // upload the mesh if needed and bind its buffers
+    auto& glmesh = update_gl_mesh(mesh, dynamic);
     
-    // enable vertex attributes arrays and set up pointers to the mesh data
-    auto vertex_pos_location = glGetAttribLocation(gl_program_id, "vertex_pos");
-    auto vertex_norm_location = glGetAttribLocation(gl_program_id, "vertex_norm");
-    auto vertex_texcoord_location = glGetAttribLocation(gl_program_id, "vertex_texcoord");
-    auto vertex_skin_bone_ids_location = glGetAttribLocation(gl_program_id, "vertex_skin_bone_ids");
-    auto vertex_skin_bone_weights_location = glGetAttribLocation(gl_program_id, "vertex_skin_bone_weights");
+    // enable vertex attributes arrays and set up pointers to the mesh buffers
+    auto vertex_pos_location = loc.vertex_pos;
+    auto vertex_norm_location = loc.vertex_norm;
+    auto vertex_texcoord_location = loc.vertex_texcoord;
+    auto vertex_skin_bone_ids_location = loc.vertex_skin_bone_ids;
+    auto vertex_skin_bone_weights_location = loc.vertex_skin_bone_weights;
     
     glEnableVertexAttribArray(vertex_pos_location);
-    glVertexAttribPointer(vertex_pos_location, 3, GL_FLOAT, GL_FALSE, 0, &mesh->pos[0].x);
-    glEnableVertexAttribArray(vertex_norm_location);
-    glVertexAttribPointer(vertex_norm_location, 3, GL_FLOAT, GL_FALSE, 0, &mesh->norm[0].x);
-    if(not mesh->texcoord.empty()) {
+    glBindBuffer(GL_ARRAY_BUFFER, glmesh.pos_bid);
+    glVertexAttribPointer(vertex_pos_location, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    if(glmesh.norm_bid) {
+        glEnableVertexAttribArray(vertex_norm_location);
+        glBindBuffer(GL_ARRAY_BUFFER, glmesh.norm_bid);
+        glVertexAttribPointer(vertex_norm_location, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+    else glVertexAttrib3f(vertex_norm_location, 0, 0, 1);
+    if(glmesh.texcoord_bid) {
         glEnableVertexAttribArray(vertex_texcoord_location);
-        glVertexAttribPointer(vertex_texcoord_location, 2, GL_FLOAT, GL_FALSE, 0, &mesh->texcoord[0].x);
+        glBindBuffer(GL_ARRAY_BUFFER, glmesh.texcoord_bid);
+        glVertexAttribPointer(vertex_texcoord_location, 2, GL_FLOAT, GL_FALSE, 0, 0);
     }
     else glVertexAttrib2f(vertex_texcoord_location, 0, 0);
     
     if (mesh->skinning and skinning_gpu) {
-        glUniform1i(glGetUniformLocation(gl_program_id,"skinning->enabled"),GL_TRUE);
-        glUniformMatrix4fv(glGetUniformLocation(gl_program_id,"skinning->bone_xforms"),
-                           mesh->skinning->bone_xforms[time].size(), GL_TRUE,
-                           &mesh->skinning->bone_xforms[time][0].x.x);
+        glUniform1i(loc.skin_enabled,GL_TRUE);
+        // bind the bone xforms texture after the material ones
+        glActiveTexture(GL_TEXTURE3);
+        update_gl_mesh_bones(mesh, glmesh, time);
+        glUniform1i(loc.skin_bone_xforms, 3);
+        glUniform1f(loc.skin_bones_num, glmesh.bones);
         glEnableVertexAttribArray(vertex_skin_bone_ids_location);
         glEnableVertexAttribArray(vertex_skin_bone_weights_location);
-        glVertexAttribPointer(vertex_skin_bone_ids_location, 4, GL_INT, GL_FALSE, 0, mesh->skinning->bone_ids.data());
-        glVertexAttribPointer(vertex_skin_bone_weights_location, 4, GL_FLOAT, GL_FALSE, 0, mesh->skinning->bone_weights.data());
+        glBindBuffer(GL_ARRAY_BUFFER, glmesh.bone_ids_bid);
+        glVertexAttribPointer(vertex_skin_bone_ids_location, 4, GL_FLOAT, GL_FALSE, 0, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, glmesh.bone_weights_bid);
+        glVertexAttribPointer(vertex_skin_bone_weights_location, 4, GL_FLOAT, GL_FALSE, 0, 0);
     } else {
-        glUniform1i(glGetUniformLocation(gl_program_id,"skinning->enabled"),GL_FALSE);
+        glUniform1i(loc.skin_enabled,GL_FALSE);
     }
     
-    // draw triangles and quads
+    // draw the primitives from the element buffer (indices are given as byte offsets in it)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glmesh.elements_bid);
+    auto elements = [](const vec2i& span) { return (const void*)(span.x*sizeof(int)); };
+    
+    // draw triangles (quads were split at upload)
     if(draw_faces) {
-        if(mesh->triangle.size()) glDrawElements(GL_TRIANGLES, mesh->triangle.size()*3, GL_UNSIGNED_INT, &mesh->triangle[0].x);
-        if(mesh->quad.size())     glDrawElements(GL_QUADS, mesh->quad.size()*4, GL_UNSIGNED_INT, &mesh->quad[0].x);
+        if(glmesh.triangles.y) glDrawElements(GL_TRIANGLES, glmesh.triangles.y, GL_UNSIGNED_INT, elements(glmesh.triangles));
     }
     
     if(draw_points) {
-        if(mesh->point.size()) glDrawElements(GL_POINTS, mesh->point.size(), GL_UNSIGNED_INT, &mesh->point[0]);
+        if(glmesh.points.y) glDrawElements(GL_POINTS, glmesh.points.y, GL_UNSIGNED_INT, elements(glmesh.points));
     }
     
     if(draw_lines) {
-        if(mesh->line.size()) glDrawElements(GL_LINES, mesh->line.size(), GL_UNSIGNED_INT, &mesh->line[0].x);
-        for(auto segment : mesh->spline) glDrawElements(GL_LINE_STRIP, 4, GL_UNSIGNED_INT, &segment);
+        if(glmesh.lines.y) glDrawElements(GL_LINES, glmesh.lines.y, GL_UNSIGNED_INT, elements(glmesh.lines));
     }
     
+    // draw edges from their cached buffer
     if(draw_edges) {
-        auto edges = EdgeMap(mesh->triangle, mesh->quad).edges();
-        glDrawElements(GL_LINES, edges.size()*2, GL_UNSIGNED_INT, &edges[0].x);
+        update_gl_mesh_edges(mesh, glmesh);
+        if(glmesh.edges) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glmesh.edges_bid);
+            glDrawElements(GL_LINES, glmesh.edges, GL_UNSIGNED_INT, 0);
+        }
     }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     
     // disable vertex attribute arrays
     glDisableVertexAttribArray(vertex_pos_location);
-    glDisableVertexAttribArray(vertex_norm_location);
-    if(not mesh->texcoord.empty()) glDisableVertexAttribArray(vertex_texcoord_location);
-    if(mesh->skinning) {
+    if(glmesh.norm_bid) glDisableVertexAttribArray(vertex_norm_location);
+    if(glmesh.texcoord_bid) glDisableVertexAttribArray(vertex_texcoord_location);
+    if(mesh->skinning and skinning_gpu) {
         glDisableVertexAttribArray(vertex_skin_bone_ids_location);
         glDisableVertexAttribArray(vertex_skin_bone_weights_location);
     }
     
     // draw normals if needed
     if(draw_normals) {
-        glUniform3fv(glGetUniformLocation(gl_program_id,"material_kd"),
-                     1,&zero3f.x);
-        glUniform3fv(glGetUniformLocation(gl_program_id,"material_ks"),
-                     1,&zero3f.x);
+        glUniform3fv(loc.material_kd,1,&zero3f.x);
+        glUniform3fv(loc.material_ks,1,&zero3f.x);
         glBegin(GL_LINES);
         for(auto i : range(mesh->pos.size())) {
             auto p0 = mesh->pos[i];
             auto p1 = mesh->pos[i] + mesh->norm[i]*0.1;
             glVertexAttrib3fv(0,&p0.x);
             glVertexAttrib3fv(0,&p1.x);
-            if(mesh->mat->double_sided) {
+            if(mat->double_sided) {
                 auto p2 = mesh->pos[i] - mesh->norm[i]*0.1;
                 glVertexAttrib3fv(0,&p0.x);
                 glVertexAttrib3fv(0,&p2.x);
@@ -590,6 +964,17 @@ void shade_mesh(Mesh* mesh, int time) {
     }
 }
 
+// shade a mesh with its own material and frame
+void shade_mesh(Mesh* mesh, int time, bool dynamic) {
+    shade_mesh(mesh, mesh->mat, frame_to_matrix(mesh->frame), time, dynamic);
+}
+
+// shade a surface by drawing its shared unit display mesh scaled by the radius
+void shade_surface(Surface* surface, int time) {
+    shade_mesh(surface->_display_mesh, surface->mat,
+               frame_to_matrix(surface->frame)*scaling_matrix(one3f*surface->radius), time, false);
+}
+
 // render the scene with OpenGL
 void shade(Scene* scene) {
     // enable depth test
@@ -612,40 +997,43 @@ void shade(Scene* scene) {
     
     // bind camera's position, inverse of frame and projection
     // use frame_to_matrix_inverse and frustum_matrix
-    glUniform3fv(glGetUniformLocation(gl_program_id,"camera_pos"),
-                 1, &scene->camera->frame.o.x);
-    glUniformMatrix4fv(glGetUniformLocation(gl_program_id,"camera_frame_inverse"),
+    auto& loc = gl_locations;
+    glUniform3fv(loc.camera_pos, 1, &scene->camera->frame.o.x);
+    glUniformMatrix4fv(loc.camera_frame_inverse,
                        1, true, &frame_to_matrix_inverse(scene->camera->frame)[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(gl_program_id,"camera_projection"),
+    glUniformMatrix4fv(loc.camera_projection,
                        1, true, &frustum_matrix(-scene->camera->dist*scene->camera->width/2, scene->camera->dist*scene->camera->width/2,
                                                 -scene->camera->dist*scene->camera->height/2, scene->camera->dist*scene->camera->height/2,
                                                 scene->camera->dist,10000)[0][0]);
     
-    // bind ambient and number of lights
-    glUniform3fv(glGetUniformLocation(gl_program_id,"ambient"),1,&scene->ambient.x);
-    glUniform1i(glGetUniformLocation(gl_program_id,"lights_num"),scene->lights.size());
+    // bind ambient and number of lights (the shader holds at most shader_max_lights)
+    auto lights_num = min((int)scene->lights.size(), shader_max_lights);
+    glUniform3fv(loc.ambient,1,&scene->ambient.x);
+    glUniform1i(loc.lights_num,lights_num);
     
-    // foreach light
-    auto count = 0;
-    for(auto light : scene->lights) {
-        // bind light position and internsity (create param name with tostring)
-        glUniform3fv(glGetUniformLocation(gl_program_id,tostring("light_pos[%d]",count).c_str()),
-                     1, &light->frame.o.x);
-        glUniform3fv(glGetUniformLocation(gl_program_id,tostring("light_intensity[%d]",count).c_str()),
-                     1, &light->intensity.x);
-        count++;
+    // bind light positions and intensities as whole arrays
+    if(lights_num) {
+        auto light_pos = vector<vec3f>(lights_num);
+        auto light_intensity = vector<vec3f>(lights_num);
+        for(auto i : range(lights_num)) {
+            light_pos[i] = scene->lights[i]->frame.o;
+            light_intensity[i] = scene->lights[i]->intensity;
+        }
+        glUniform3fv(loc.light_pos, lights_num, &light_pos[0].x);
+        glUniform3fv(loc.light_intensity, lights_num, &light_intensity[0].x);
     }
     
     // foreach mesh
     for(auto mesh : scene->meshes) {
-        // draw mesh
-        shade_mesh(mesh, scene->animation->time);
+        // draw mesh (or its subdivided display mesh), streaming it if skinned on the cpu or simulated
+        auto dynamic = (mesh->skinning and not (skinning_gpu and not mesh->_display_mesh)) or mesh->simulation;
+        shade_mesh((mesh->_display_mesh) ? mesh->_display_mesh : mesh, scene->animation->time, dynamic);
     }
     
     // foreach surface
     for(auto surface : scene->surfaces) {
         // draw display mesh
-        shade_mesh(surface->_display_mesh, scene->animation->time);
+        shade_surface(surface, scene->animation->time);
     }
 }
 
@@ -660,6 +1048,7 @@ void uiloop() {
     glfwSetErrorCallback([](int ecode, const char* msg){ return error(msg); });
     
     glfwWindowHint(GLFW_SAMPLES, scene->image_samples);
+    if(headless) glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
 
     auto window = glfwCreateWindow(scene->image_width, scene->image_height,
                                    "graphics | animate", NULL, NULL);
@@ -670,9 +1059,13 @@ void uiloop() {
     glfwSetCharCallback(window, [](GLFWwindow* window, unsigned int key) {
         switch (key) {
             case 's': { save = true; } break;
+            case 'c': { capture = not capture; capture_time = -1; } break;
             case ' ': { animate = not animate; } break;
             case '.': { animate_update(scene, skinning_gpu); } break;
-            case 'g': { skinning_gpu = not skinning_gpu; animate_reset(scene); } break;
+            case 'g': {
+                if(gl_skinning_supported) { skinning_gpu = not skinning_gpu; animate_reset(scene); }
+                else message("gpu skinning is not supported\n");
+            } break;
             case 'n': { draw_normals = not draw_normals; } break;
             case 'e': { draw_edges = not draw_edges; } break;
             case 'p': { draw_points = not draw_points; } break;
@@ -693,8 +1086,25 @@ void uiloop() {
     auto mouse_last_y = -1.0;
     
     auto last_update_time = glfwGetTime();
+    auto last_watch_time = glfwGetTime();
+    
+    // headless runs draw each animation frame once in an offscreen framebuffer and capture it
+    if(headless) {
+        scene->camera->width = (scene->camera->height * scene->image_width) / scene->image_height;
+        init_capture_framebuffer(scene);
+        for(auto frame = 0; frame < scene->animation->length; frame ++) {
+            shade(scene);
+            capture_frame(scene);
+            animate_update(scene, skinning_gpu);
+        }
+    }
     
-    while(not glfwWindowShouldClose(window)) {
+    while(not headless and not glfwWindowShouldClose(window)) {
+        if(scene_watch and glfwGetTime() - last_watch_time > 0.5) {
+            last_watch_time = glfwGetTime();
+            reload_scene(scene);
+        }
+        
         auto title = tostring("graphics | animate | %03d", scene->animation->time);
         glfwSetWindowTitle(window, title.c_str());
         
@@ -734,10 +1144,16 @@ void uiloop() {
             save = false;
         }
         
+        if(capture and capture_time != scene->animation->time) capture_frame(scene);
+        
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
     
+    // finish writing the captured frames
+    if(capture_writer) delete capture_writer;
+    if(capture_video) delete capture_video;
+    
     glfwDestroyWindow(window);
     
     glfwTerminate();
@@ -0,0 +1,416 @@
+#include "scene.h"
+#include "binary.h"
+
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// kind of asset stored in a file
+enum AssetKind { asset_none, asset_mesh, asset_skinning };
+
+// kind of asset stored in a json value (scenes and other files are not assets)
+AssetKind json_asset_kind(const jsonvalue& json) {
+    if(not json.is_object()) return asset_none;
+    auto kind = asset_none;
+    for(auto& kv : json.as_object_ref()) {
+        auto& key = kv.first;
+        if(key == "bone_ids" or key == "bone_weights" or key == "bone_xforms") kind = asset_skinning;
+        if(key == "pos" or key == "triangle" or key == "quad" or key == "point" or key == "line" or key == "spline") kind = asset_mesh;
+    }
+    return kind;
+}
+
+// kind of asset stored in a binary file
+AssetKind bin_asset_kind(const string& filename) {
+    auto bin = BinaryFile(filename);
+    if(bin.has_section("bone_ids") or bin.has_section("bone_weights") or bin.has_section("bone_xforms")) return asset_skinning;
+    return asset_mesh;
+}
+
+// json array of elements made of N values of type E, flattened as in the json assets
+template<typename E, int N, typename T>
+jsonvalue json_array_value(const vector<T>& value) {
+    auto array = jsonvalue::numarray();
+    array.reserve(value.size()*N);
+    for(auto i : range(value.size()*N)) array.push_back(((const E*)value.data())[i]);
+    return jsonvalue(std::move(array));
+}
+template<typename E, int N, typename T>
+jsonvalue json_array_value(const vector<vector<T>>& value) {
+    auto array = jsonvalue::array();
+    for(auto& row : value) array.push_back(json_array_value<E,N>(row));
+    return jsonvalue(std::move(array));
+}
+jsonvalue json_array_value(const vector<bool>& value) {
+    auto array = jsonvalue::array();
+    for(auto b : value) array.push_back(jsonvalue((bool)b));
+    return jsonvalue(std::move(array));
+}
+
+// add a json array to an object, skipping empty arrays
+template<typename E, int N, typename T>
+void json_add_array(jsonvalue::object& json, const string& name, const vector<T>& value) {
+    if(not value.empty()) json[name] = json_array_value<E,N>(value);
+}
+void json_add_array(jsonvalue::object& json, const string& name, const vector<bool>& value) {
+    if(not value.empty()) json[name] = json_array_value(value);
+}
+
+// json value of a skinning, with the same keys read by json_parse_mesh_skinning
+jsonvalue json_mesh_skinning_value(const MeshSkinning* skinning) {
+    auto json = jsonvalue::object();
+    json_add_array<float,3>(json, "rest_pos", skinning->rest_pos);
+    json_add_array<float,3>(json, "rest_norm", skinning->rest_norm);
+    json_add_array<int,4>(json, "bone_ids", skinning->bone_ids);
+    json_add_array<float,4>(json, "bone_weights", skinning->bone_weights);
+    json_add_array<float,16>(json, "bone_xforms", skinning->bone_xforms);
+    return jsonvalue(std::move(json));
+}
+
+// json value of a simulation, with the same keys read by json_parse_mesh_simulation
+jsonvalue json_mesh_simulation_value(const MeshSimulation* simulation) {
+    auto json = jsonvalue::object();
+    json_add_array<float,3>(json, "init_pos", simulation->init_pos);
+    json_add_array<float,3>(json, "init_vel", simulation->init_vel);
+    json_add_array<float,1>(json, "mass", simulation->mass);
+    json_add_array(json, "pinned", simulation->pinned);
+    json_add_array<float,3>(json, "vel", simulation->vel);
+    json_add_array<float,3>(json, "force", simulation->force);
+    if(not simulation->springs.empty()) {
+        auto springs = jsonvalue::array();
+        for(auto& spring : simulation->springs) {
+            auto elem = jsonvalue::object();
+            elem["ids"] = json_array_value<int,2>(vector<vec2i>(1,spring.ids));
+            elem["restlength"] = jsonvalue((double)spring.restlength);
+            elem["ks"] = jsonvalue((double)spring.ks);
+            elem["kd"] = jsonvalue((double)spring.kd);
+            springs.push_back(jsonvalue(std::move(elem)));
+        }
+        json["springs"] = jsonvalue(std::move(springs));
+    }
+    return jsonvalue(std::move(json));
+}
+
+// json value of a mesh, with the same keys read by json_parse_mesh; meta holds the other values
+jsonvalue json_mesh_value(const Mesh* mesh, const jsonvalue& meta) {
+    auto json = (meta.is_object()) ? meta.as_object_ref() : jsonvalue::object();
+    json_add_array<float,3>(json, "pos", mesh->pos);
+    json_add_array<float,3>(json, "norm", mesh->norm);
+    json_add_array<float,2>(json, "texcoord", mesh->texcoord);
+    json_add_array<int,3>(json, "triangle", mesh->triangle);
+    json_add_array<int,4>(json, "quad", mesh->quad);
+    json_add_array<int,1>(json, "point", mesh->point);
+    json_add_array<int,2>(json, "line", mesh->line);
+    json_add_array<int,4>(json, "spline", mesh->spline);
+    if(mesh->skinning) json["skinning"] = json_mesh_skinning_value(mesh->skinning);
+    if(mesh->simulation) json["simulation"] = json_mesh_simulation_value(mesh->simulation);
+    return jsonvalue(std::move(json));
+}
+
+// exact comparison of arrays
+template<typename T>
+bool equal_array(const vector<T>& a, const vector<T>& b) {
+    return a.size() == b.size() and (a.empty() or memcmp(a.data(), b.data(), sizeof(T)*a.size()) == 0);
+}
+template<typename T>
+bool equal_array(const vector<vector<T>>& a, const vector<vector<T>>& b) {
+    if(a.size() != b.size()) return false;
+    for(auto i : range(a.size())) if(not equal_array(a[i], b[i])) return false;
+    return true;
+}
+
+// exact comparison of skinnings
+bool equal_mesh_skinning(const MeshSkinning* a, const MeshSkinning* b) {
+    if(not a or not b) return a == b;
+    return equal_array(a->rest_pos, b->rest_pos) and equal_array(a->rest_norm, b->rest_norm) and
+        equal_array(a->bone_ids, b->bone_ids) and equal_array(a->bone_weights, b->bone_weights) and
+        equal_array(a->bone_xforms, b->bone_xforms);
+}
+
+// exact comparison of simulations
+bool equal_mesh_simulation(const MeshSimulation* a, const MeshSimulation* b) {
+    if(not a or not b) return a == b;
+    if(a->springs.size() != b->springs.size()) return false;
+    for(auto i : range(a->springs.size())) {
+        auto& sa = a->springs[i]; auto& sb = b->springs[i];
+        if(not (sa.ids == sb.ids) or sa.restlength != sb.restlength or sa.ks != sb.ks or sa.kd != sb.kd) return false;
+    }
+    return equal_array(a->init_pos, b->init_pos) and equal_array(a->init_vel, b->init_vel) and
+        equal_array(a->mass, b->mass) and a->pinned == b->pinned and
+        equal_array(a->vel, b->vel) and equal_array(a->force, b->force);
+}
+
+// comparison of texture references (textures are shared, so their files are compared)
+bool equal_texture(Texture* a, Texture* b) {
+    if(not a or not b) return a == b;
+    return texture_filename(a) == texture_filename(b);
+}
+
+// exact comparison of materials, including their texture references
+bool equal_material(const Material* a, const Material* b) {
+    if(not a or not b) return a == b;
+    return a->kd == b->kd and a->ks == b->ks and a->n == b->n and a->kr == b->kr and a->ke == b->ke and
+        equal_texture(a->kd_txt, b->kd_txt) and equal_texture(a->ks_txt, b->ks_txt) and
+        equal_texture(a->kr_txt, b->kr_txt) and equal_texture(a->norm_txt, b->norm_txt) and
+        equal_texture(a->ke_txt, b->ke_txt) and
+        a->double_sided == b->double_sided and a->microfacet == b->microfacet;
+}
+
+// exact comparison of keyframed animations
+bool equal_frame_animation(const FrameAnimation* a, const FrameAnimation* b) {
+    if(not a or not b) return a == b;
+    return a->rest_frame == b->rest_frame and equal_array(a->keytimes, b->keytimes) and
+        equal_array(a->translation, b->translation) and equal_array(a->rotation, b->rotation);
+}
+
+// exact comparison of meshes, over every value saved in binary assets
+bool equal_mesh(const Mesh* a, const Mesh* b) {
+    return a->frame == b->frame and
+        equal_array(a->pos, b->pos) and equal_array(a->norm, b->norm) and
+        equal_array(a->texcoord, b->texcoord) and equal_array(a->triangle, b->triangle) and
+        equal_array(a->quad, b->quad) and equal_array(a->point, b->point) and
+        equal_array(a->line, b->line) and equal_array(a->spline, b->spline) and
+        equal_material(a->mat, b->mat) and
+        a->subdivision_catmullclark_level == b->subdivision_catmullclark_level and
+        a->subdivision_catmullclark_smooth == b->subdivision_catmullclark_smooth and
+        a->subdivision_catmullclark_adaptive == b->subdivision_catmullclark_adaptive and
+        a->subdivision_catmullclark_adaptive_angle == b->subdivision_catmullclark_adaptive_angle and
+        a->subdivision_catmullclark_adaptive_area == b->subdivision_catmullclark_adaptive_area and
+        a->subdivision_bezier_level == b->subdivision_bezier_level and
+        a->subdivision_bezier_uniform == b->subdivision_bezier_uniform and
+        a->subdivision_bezier_tolerance == b->subdivision_bezier_tolerance and
+        equal_frame_animation(a->animation, b->animation) and
+        equal_mesh_skinning(a->skinning, b->skinning) and
+        equal_mesh_simulation(a->simulation, b->simulation);
+}
+
+// file size in bytes
+long file_size(const string& filename) {
+    auto f = fopen(filename.c_str(), "rb");
+    error_if_not(f, "cannot open file: %s\n", filename.c_str());
+    fseek(f, 0, SEEK_END);
+    auto size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// list files with a given extension in a directory and its subdirectories
+void list_files(const string& dirname, const string& ext, vector<string>& filenames) {
+#ifdef _WIN32
+    _finddata_t data;
+    auto handle = _findfirst((dirname+"/*").c_str(), &data);
+    if(handle == -1) return;
+    do {
+        auto name = string(data.name);
+        if(name == "." or name == "..") continue;
+        auto filename = dirname + "/" + name;
+        if(data.attrib & _A_SUBDIR) list_files(filename, ext, filenames);
+        else if(name.size() > ext.size() and name.substr(name.size()-ext.size()) == ext) filenames.push_back(filename);
+    } while(_findnext(handle, &data) == 0);
+    _findclose(handle);
+#else
+    auto dir = opendir(dirname.c_str());
+    error_if_not(dir, "cannot open directory: %s\n", dirname.c_str());
+    while(auto entry = readdir(dir)) {
+        auto name = string(entry->d_name);
+        if(name == "." or name == "..") continue;
+        auto filename = dirname + "/" + name;
+        struct stat st;
+        if(stat(filename.c_str(), &st) != 0) continue;
+        if(S_ISDIR(st.st_mode)) list_files(filename, ext, filenames);
+        else if(name.size() > ext.size() and name.substr(name.size()-ext.size()) == ext) filenames.push_back(filename);
+    }
+    closedir(dir);
+#endif
+}
+
+// whether a path is a directory
+bool is_directory(const string& path) {
+#ifdef _WIN32
+    _finddata_t data;
+    auto handle = _findfirst(path.c_str(), &data);
+    if(handle == -1) return false;
+    _findclose(handle);
+    return data.attrib & _A_SUBDIR;
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 and S_ISDIR(st.st_mode);
+#endif
+}
+
+// time in milliseconds spent running f
+template<typename F>
+double time_ms(const F& f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    return std::chrono::duration<double,std::milli>(std::chrono::high_resolution_clock::now()-start).count();
+}
+
+// outcome of a conversion
+struct ConvertResult {
+    string  filename;           // input filename
+    string  outname;            // output filename
+    bool    converted = false;  // whether the file was an asset and was converted
+    string  error;              // why the file could not be converted (empty if it was, or was not an asset)
+    long    json_size = 0;      // size of the json file
+    long    bin_size = 0;       // size of the binary file
+    double  json_time = 0;      // json load time (ms)
+    double  bin_time = 0;       // binary load time (ms)
+    bool    verified = false;   // whether the round trip was checked
+    bool    equal = false;      // whether the round trip preserved the asset
+};
+
+// convert a json asset to binary, optionally checking that json -> bin -> json preserves it
+ConvertResult convert_json_to_bin(const string& filename, const string& binname, bool verify) {
+    auto result = ConvertResult();
+    result.filename = filename;
+    result.outname = binname;
+    // malformed files would stop the loaders, so they are checked first and reported instead
+    auto json = jsonvalue();
+    if(not load_json(filename, json, result.error)) return result;
+    auto kind = json_asset_kind(json);
+    if(kind == asset_none) return result;
+    auto valid = (kind == asset_skinning) ? check_json_mesh_skinning(json, result.error) :
+                                            check_json_mesh(json, json_dirname(filename), result.error);
+    if(not valid) return result;
+    if(kind == asset_skinning) {
+        auto skinning = (MeshSkinning*)nullptr;
+        result.json_time = time_ms([&](){ skinning = load_json_mesh_skinning(filename); });
+        save_bin_mesh_skinning(binname, skinning);
+        if(verify) {
+            auto reference = json_parse_mesh_skinning(load_json(filename));
+            auto loaded = (MeshSkinning*)nullptr;
+            result.bin_time = time_ms([&](){ loaded = load_bin_mesh_skinning(binname); });
+            auto back = json_parse_mesh_skinning(parse_json(format_json(json_mesh_skinning_value(loaded))));
+            result.equal = equal_mesh_skinning(reference, skinning) and equal_mesh_skinning(reference, loaded) and equal_mesh_skinning(reference, back);
+            delete reference; delete loaded; delete back;
+        }
+        delete skinning;
+    } else {
+        auto meta = jsonvalue();
+        auto mesh = (Mesh*)nullptr;
+        result.json_time = time_ms([&](){ mesh = load_json_mesh(filename, &meta); });
+        save_bin_mesh(binname, mesh, meta);
+        if(verify) {
+            auto reference = json_parse_mesh(load_json(filename), json_dirname(filename));
+            auto loaded = (Mesh*)nullptr;
+            result.bin_time = time_ms([&](){ loaded = load_bin_mesh(binname); });
+            auto back = json_parse_mesh(parse_json(format_json(json_mesh_value(loaded, meta))), json_dirname(filename));
+            result.equal = equal_mesh(reference, mesh) and equal_mesh(reference, loaded) and equal_mesh(reference, back);
+            delete reference; delete loaded; delete back;
+        }
+        delete mesh;
+    }
+    result.converted = true;
+    result.verified = verify;
+    result.json_size = file_size(filename);
+    result.bin_size = file_size(binname);
+    return result;
+}
+
+// convert a binary asset to json, optionally checking that bin -> json -> bin preserves it
+ConvertResult convert_bin_to_json(const string& filename, const string& jsonname, bool verify) {
+    auto result = ConvertResult();
+    result.filename = filename;
+    result.outname = jsonname;
+    // malformed files would stop the loaders, so they are checked first and reported instead
+    if(not check_binary_file(filename, result.error)) return result;
+    auto kind = bin_asset_kind(filename);
+    auto valid = (kind == asset_skinning) ? check_bin_mesh_skinning(filename, result.error) : check_bin_mesh(filename, result.error);
+    if(not valid) return result;
+    if(kind == asset_skinning) {
+        auto skinning = (MeshSkinning*)nullptr;
+        result.bin_time = time_ms([&](){ skinning = load_bin_mesh_skinning(filename); });
+        save_json(jsonname, json_mesh_skinning_value(skinning));
+        if(verify) {
+            auto loaded = (MeshSkinning*)nullptr;
+            result.json_time = time_ms([&](){ loaded = load_json_mesh_skinning(jsonname); });
+            auto back = json_parse_mesh_skinning(load_json(jsonname));
+            result.equal = equal_mesh_skinning(skinning, loaded) and equal_mesh_skinning(skinning, back);
+            delete loaded; delete back;
+        }
+        delete skinning;
+    } else {
+        auto mesh = (Mesh*)nullptr;
+        result.bin_time = time_ms([&](){ mesh = load_bin_mesh(filename); });
+        auto meta = BinaryFile(filename).read_text("meta");
+        save_json(jsonname, json_mesh_value(mesh, (meta.empty()) ? jsonvalue() : parse_json(meta)));
+        if(verify) {
+            auto loaded = (Mesh*)nullptr;
+            result.json_time = time_ms([&](){ loaded = load_json_mesh(jsonname); });
+            auto back = json_parse_mesh(load_json(jsonname), json_dirname(jsonname));
+            result.equal = equal_mesh(mesh, loaded) and equal_mesh(mesh, back);
+            delete loaded; delete back;
+        }
+        delete mesh;
+    }
+    result.converted = true;
+    result.verified = verify;
+    result.json_size = file_size(jsonname);
+    result.bin_size = file_size(filename);
+    return result;
+}
+
+// main function
+int main(int argc, char** argv) {
+    auto args = parse_cmdline(argc, argv,
+        { "asset_convert", "convert json meshes and skinnings to binary asset files and back",
+            {  {"to_json", "j", "convert binary files to json", typeid(bool), true, jsonvalue(false) },
+               {"verify", "v", "verify round trip and report load times", typeid(bool), true, jsonvalue(false) }  },
+            {  {"input", "", "input file or directory (converted recursively)", typeid(string), false, jsonvalue("mesh.json")},
+               {"output_filename", "", "output filename (single files only)", typeid(string), true, jsonvalue("")}  }
+        });
+
+    auto to_json = args.object_element("to_json").as_bool();
+    auto verify = args.object_element("verify").as_bool();
+    auto input = args.object_element("input").as_string();
+    auto in_ext = string((to_json) ? ".bin" : ".json");
+    auto out_ext = string((to_json) ? ".json" : ".bin");
+
+    // files to convert and their outputs
+    auto filenames = vector<string>();
+    auto outnames = vector<string>();
+    if(is_directory(input)) {
+        list_files(input, in_ext, filenames);
+        std::sort(filenames.begin(), filenames.end());
+        for(auto& filename : filenames) outnames.push_back(filename.substr(0,filename.size()-in_ext.size())+out_ext);
+    } else {
+        filenames.push_back(input);
+        outnames.push_back((args.object_element("output_filename").as_string() != "") ?
+            args.object_element("output_filename").as_string() :
+            input.substr(0,input.rfind('.'))+out_ext);
+    }
+
+    // convert in parallel, one file per task (the texture cache shared by the loaders is thread-safe)
+    auto results = vector<ConvertResult>(filenames.size());
+    parallel_for(filenames.size(), [&](int start, int end){
+        for(auto i : range(start,end)) {
+            results[i] = (to_json) ? convert_bin_to_json(filenames[i], outnames[i], verify) :
+                                     convert_json_to_bin(filenames[i], outnames[i], verify);
+        }
+    }, 1);
+
+    // report
+    auto json_size = 0l, bin_size = 0l;
+    auto json_time = 0.0, bin_time = 0.0;
+    auto failed = 0;
+    for(auto& result : results) {
+        if(not result.error.empty()) { message("%s: NOT CONVERTED, %s\n", result.filename.c_str(), result.error.c_str()); failed ++; continue; }
+        if(not result.converted) continue;
+        json_size += result.json_size; bin_size += result.bin_size;
+        json_time += result.json_time; bin_time += result.bin_time;
+        if(result.verified and not result.equal) failed ++;
+        if(result.verified) message("%s -> %s: size %.2fx, load %.1fx%s\n", result.filename.c_str(), result.outname.c_str(),
+                                    (double)result.json_size / result.bin_size, result.json_time / result.bin_time,
+                                    (result.equal) ? "" : ", ROUND TRIP FAILED");
+        else message("%s -> %s\n", result.filename.c_str(), result.outname.c_str());
+    }
+    if(verify and bin_size) message("total: json %ld bytes, bin %ld bytes (%.2fx), json load %.1fms, bin load %.1fms (%.1fx)\n",
+                                    json_size, bin_size, (double)json_size / bin_size, json_time, bin_time, json_time / bin_time);
+    return (failed) ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+#include "binary.h"
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// check that the machine stores values as the file does
+static bool _is_little_endian() { auto one = (uint32_t)1; return *(char*)&one == 1; }
+
+MappedFile::MappedFile(const string& filename, bool sequential) {
+#ifdef _WIN32
+    // no mmap: read the whole file in memory
+    auto f = fopen(filename.c_str(), "rb");
+    error_if_not(f, "cannot open file: %s\n", filename.c_str());
+    fseek(f, 0, SEEK_END);
+    _size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    auto data = new char[_size];
+    error_if_not(fread(data, 1, _size, f) == _size, "cannot read file: %s\n", filename.c_str());
+    fclose(f);
+    _data = data;
+#else
+    auto fd = open(filename.c_str(), O_RDONLY);
+    error_if_not(fd >= 0, "cannot open file: %s\n", filename.c_str());
+    struct stat st;
+    error_if_not(fstat(fd, &st) == 0, "cannot read file: %s\n", filename.c_str());
+    _size = st.st_size;
+    auto data = (_size) ? mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    error_if_not(data != MAP_FAILED, "cannot map file: %s\n", filename.c_str());
+    if(sequential) madvise(data, _size, MADV_SEQUENTIAL);
+    _data = (const char*)data;
+    _mapped = true;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    delete [] _data;
+#else
+    if(_mapped) munmap((void*)_data, _size);
+#endif
+}
+
+// first problem with the header and section table of a binary file in memory (empty if none)
+static string _check_binary(const char* data, size_t size, const string& filename) {
+    if(not _is_little_endian()) return "binary files are only supported on little-endian machines";
+    if(size < sizeof(BinaryHeader)) return tostring("corrupted binary file: %s", filename.c_str());
+    auto header = (const BinaryHeader*)data;
+    if(strncmp(header->magic, BINARY_MAGIC, 8) != 0) return tostring("not a binary asset file: %s", filename.c_str());
+    if(header->version != BINARY_VERSION) return tostring("unsupported binary version %d in %s", (int)header->version, filename.c_str());
+    if(size < sizeof(BinaryHeader) + header->nsections*sizeof(BinarySection)) return tostring("corrupted binary file: %s", filename.c_str());
+    auto sections = (const BinarySection*)(data + sizeof(BinaryHeader));
+    for(auto i = (uint32_t)0; i < header->nsections; i ++) {
+        auto& sec = sections[i];
+        auto sec_size = sec.count * sec.components * ((sec.type == bin_byte or sec.type == bin_text) ? 1 : 4);
+        if(sec.offset % 16 != 0 or sec.offset + sec_size > size or sec.rows == 0) return tostring("corrupted binary file: %s", filename.c_str());
+    }
+    return string();
+}
+
+BinaryFile::BinaryFile(const string& filename) : _filename(filename), _file(filename) {
+    _data = _file._data;
+    _size = _file._size;
+    // header and section table
+    auto msg = _check_binary(_data, _size, filename);
+    error_if_not(msg.empty(), "%s\n", msg.c_str());
+    auto header = (const BinaryHeader*)_data;
+    auto sections = (const BinarySection*)(_data + sizeof(BinaryHeader));
+    _sections.assign(sections, sections + header->nsections);
+}
+
+bool check_binary_file(const string& filename, string& msg) {
+    // an empty or missing file cannot be mapped, so these are checked first
+    auto f = fopen(filename.c_str(), "rb");
+    if(not f) { msg = tostring("cannot open file: %s", filename.c_str()); return false; }
+    fseek(f, 0, SEEK_END);
+    auto size = ftell(f);
+    fclose(f);
+    if(size < (long)sizeof(BinaryHeader)) { msg = tostring("corrupted binary file: %s", filename.c_str()); return false; }
+    auto file = MappedFile(filename);
+    msg = _check_binary(file._data, file._size, filename);
+    return msg.empty();
+}
+
+const BinarySection* BinaryFile::section(const string& name) const {
+    for(auto& sec : _sections) if(strncmp(sec.name, name.c_str(), sizeof(sec.name)) == 0) return &sec;
+    return nullptr;
+}
+
+void BinaryFile::read(const string& name, vector<bool>& value) const {
+    if(not has_section(name)) return;
+    auto count = 0;
+    auto data = view<char,1,char>(name, count);
+    value.assign(data, data + count);
+}
+
+string BinaryFile::read_text(const string& name) const {
+    auto sec = section(name);
+    if(not sec) return string();
+    error_if_not(sec->type == bin_text, "wrong section type %s in %s\n", name.c_str(), _filename.c_str());
+    return string(_data + sec->offset, sec->count);
+}
+
+vector<BinarySection> read_binary_sections(const string& filename) {
+    error_if_not(_is_little_endian(), "binary files are only supported on little-endian machines\n");
+    auto f = fopen(filename.c_str(), "rb");
+    error_if_not(f, "cannot open file: %s\n", filename.c_str());
+    auto header = BinaryHeader();
+    error_if_not(fread(&header, sizeof(header), 1, f) == 1, "corrupted binary file: %s\n", filename.c_str());
+    error_if_not(strncmp(header.magic, BINARY_MAGIC, 8) == 0, "not a binary asset file: %s\n", filename.c_str());
+    error_if_not(header.version == BINARY_VERSION, "unsupported binary version %d in %s\n", (int)header.version, filename.c_str());
+    auto sections = vector<BinarySection>(header.nsections);
+    if(not sections.empty()) error_if_not(fread(sections.data(), sizeof(BinarySection), sections.size(), f) == sections.size(), "corrupted binary file: %s\n", filename.c_str());
+    fclose(f);
+    return sections;
+}
+
+void BinaryWriter::add(const string& name, const vector<bool>& value) {
+    if(value.empty()) return;
+    auto data = vector<char>(value.begin(), value.end());
+    _add(name, bin_byte, 1, data.size(), 1, data.data());
+}
+
+void BinaryWriter::add_text(const string& name, const string& text) {
+    _add(name, bin_text, 1, text.size(), 1, text.data());
+}
+
+void BinaryWriter::_add(const string& name, uint32_t type, int components, size_t count, size_t rows, const void* data) {
+    error_if_not(name.size() < sizeof(BinarySection::name), "section name too long: %s\n", name.c_str());
+    auto sec = BinarySection();
+    memset(&sec, 0, sizeof(sec));
+    strncpy(sec.name, name.c_str(), sizeof(sec.name)-1);
+    sec.type = type;
+    sec.components = components;
+    sec.count = count;
+    sec.rows = rows;
+    sec.offset = _data.size();
+    auto size = count * components * ((type == bin_byte or type == bin_text) ? 1 : 4);
+    _data.append((const char*)data, size);
+    _data.resize((_data.size() + 15) / 16 * 16, 0);
+    _sections.push_back(sec);
+}
+
+void BinaryWriter::save(const string& filename) const {
+    error_if_not(_is_little_endian(), "binary files are only supported on little-endian machines\n");
+    auto header = BinaryHeader();
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.nsections = _sections.size();
+    // data starts after the section table, aligned to 16 bytes
+    auto start = (sizeof(BinaryHeader) + _sections.size()*sizeof(BinarySection) + 15) / 16 * 16;
+    auto sections = _sections;
+    for(auto& sec : sections) sec.offset += start;
+    auto f = fopen(filename.c_str(), "wb");
+    error_if_not(f, "cannot open file: %s\n", filename.c_str());
+    fwrite(&header, sizeof(header), 1, f);
+    if(not sections.empty()) fwrite(sections.data(), sizeof(BinarySection), sections.size(), f);
+    auto pad = string(start - sizeof(BinaryHeader) - sections.size()*sizeof(BinarySection), 0);
+    fwrite(pad.data(), 1, pad.size(), f);
+    error_if_not(fwrite(_data.data(), 1, _data.size(), f) == _data.size(), "cannot write file: %s\n", filename.c_str());
+    fclose(f);
+}
+
+static string asset_cache_dirname;    // asset cache directory (empty if disabled)
+
+void set_asset_cache(const string& dirname) {
+    asset_cache_dirname = dirname;
+    if(dirname.empty()) return;
+#ifdef _WIN32
+    _mkdir(dirname.c_str());
+#else
+    mkdir(dirname.c_str(), 0755);
+#endif
+}
+
+bool asset_cache_enabled() {
+    return not asset_cache_dirname.empty();
+}
+
+string asset_cache_filename(uint64_t key, const string& ext) {
+    if(asset_cache_dirname.empty()) return string();
+    return asset_cache_dirname + "/" + tostring("%016llx", (unsigned long long)key) + "." + ext;
+}
+
+bool asset_cache_contains(const string& filename) {
+    // entries that cannot be read (e.g. truncated, or from another format version or platform)
+    // would stop the loaders, so they are removed and count as misses, to be written again
+    auto msg = string();
+    if(check_binary_file(filename, msg)) return true;
+    remove(filename.c_str());
+    return false;
+}
+
+void asset_cache_commit(const string& tmpname, const string& filename) {
+    // concurrent writers of the same entry write identical contents, so losing the race is fine
+    if(rename(tmpname.c_str(), filename.c_str()) != 0) remove(tmpname.c_str());
+}
+
+// temporary name used to write a cache entry before committing it, unique to this process
+// (by pid) and to this call (by counter), since processes may share the cache directory
+string asset_cache_tmpname(const string& filename) {
+    static std::atomic<int> counter(0);
+#ifdef _WIN32
+    auto pid = (long long)_getpid();
+#else
+    auto pid = (long long)getpid();
+#endif
+    return filename + tostring(".%lld.%d.tmp", pid, counter++);
+}
@@ -0,0 +1,182 @@
+#ifndef _BINARY_H_
+#define _BINARY_H_
+
+#include "common.h"
+
+#include <cstdint>
+#include <cstring>
+
+// binary asset container
+// layout: header, section table, section data; all values are little-endian and
+// every section starts at a 16-byte aligned offset so that arrays can be used in place
+// sections are named with the json path of the value they store (e.g. "pos", "skinning.bone_xforms")
+
+// file magic and current version
+#define BINARY_MAGIC    "ANIMBIN"
+#define BINARY_VERSION  1
+
+// element types of a section
+enum BinaryType { bin_float = 0, bin_int = 1, bin_byte = 2, bin_text = 3 };
+
+// file header
+struct BinaryHeader {
+    char        magic[8];       // BINARY_MAGIC
+    uint32_t    version;        // BINARY_VERSION
+    uint32_t    nsections;      // number of sections in the table following the header
+};
+
+// section table entry
+struct BinarySection {
+    char        name[48];       // section name
+    uint32_t    type;           // element type (BinaryType)
+    uint32_t    components;     // components per element (e.g. 3 for vec3f)
+    uint64_t    count;          // number of elements
+    uint64_t    rows;           // number of equal-sized rows the elements are split into (1 if flat)
+    uint64_t    offset;         // offset of the data from the start of the file
+};
+
+// read-only file contents, mapped in memory when possible (read in memory otherwise)
+struct MappedFile {
+    // open a file and map it in memory (sequential hints that pages may be dropped once read)
+    MappedFile(const string& filename, bool sequential = false);
+    // unmap the file
+    ~MappedFile();
+    
+    const char*     _data = nullptr;    // file contents
+    size_t          _size = 0;          // file size
+    bool            _mapped = false;    // whether the contents are memory mapped
+};
+
+// read-only binary file, mapped in memory when possible
+struct BinaryFile {
+    // open a file and map it in memory
+    BinaryFile(const string& filename);
+
+    // section lookup (nullptr if missing)
+    const BinarySection* section(const string& name) const;
+    // whether a section exists
+    bool has_section(const string& name) const { return section(name) != nullptr; }
+
+    // zero-copy view of a section holding elements of type T made of N values of type E
+    template<typename E, int N, typename T>
+    const T* view(const string& name, int& count) const {
+        static_assert(sizeof(T) == sizeof(E)*N, "wrong element size");
+        auto sec = section(name);
+        error_if_not(sec, "missing section %s in %s\n", name.c_str(), _filename.c_str());
+        error_if_not(sec->type == _type<E>() and sec->components == N, "wrong section type %s in %s\n", name.c_str(), _filename.c_str());
+        count = sec->count;
+        return (const T*)(_data + sec->offset);
+    }
+
+    // copy a section to a vector, leaving it untouched if the section is missing
+    template<typename E, int N, typename T>
+    void read(const string& name, vector<T>& value) const {
+        if(not has_section(name)) return;
+        auto count = 0;
+        auto data = view<E,N,T>(name, count);
+        value.resize(count);
+        if(count) memcpy(value.data(), data, sizeof(T)*count);
+    }
+    // copy a section split in rows to a vector of vectors
+    template<typename E, int N, typename T>
+    void read(const string& name, vector<vector<T>>& value) const {
+        if(not has_section(name)) return;
+        auto count = 0;
+        auto data = view<E,N,T>(name, count);
+        auto rows = (int)section(name)->rows;
+        value.resize(rows);
+        for(auto r : range(rows)) value[r].assign(data + r*(count/rows), data + (r+1)*(count/rows));
+    }
+    // copy a byte section to a vector of bools
+    void read(const string& name, vector<bool>& value) const;
+    // text section as a string (empty if missing)
+    string read_text(const string& name) const;
+
+    string                  _filename;          // filename (for errors)
+    MappedFile              _file;              // file contents
+    const char*             _data = nullptr;    // file contents (from _file)
+    size_t                  _size = 0;          // file size
+    vector<BinarySection>   _sections;          // section table
+
+    // element type codes
+    template<typename E> static uint32_t _type();
+};
+
+template<> inline uint32_t BinaryFile::_type<float>() { return bin_float; }
+template<> inline uint32_t BinaryFile::_type<int>() { return bin_int; }
+template<> inline uint32_t BinaryFile::_type<char>() { return bin_byte; }
+
+// FNV-1a hash of a block of bytes, chained through h
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t h = 14695981039346656037ull) {
+    auto bytes = (const unsigned char*)data;
+    for(auto i = (size_t)0; i < size; i ++) { h ^= bytes[i]; h *= 1099511628211ull; }
+    return h;
+}
+// hash of a value made of plain bytes
+template<typename T>
+inline uint64_t hash_value(const T& value, uint64_t h) { return hash_bytes(&value, sizeof(T), h); }
+// hash of the size and contents of an array
+template<typename T>
+inline uint64_t hash_array(const vector<T>& value, uint64_t h) {
+    h = hash_value(value.size(), h);
+    return (value.empty()) ? h : hash_bytes(value.data(), sizeof(T)*value.size(), h);
+}
+
+// on-disk asset cache: json meshes and skinnings are stored after parsing, meshes after
+// subdivision and textures after building their mip chains, as binary asset files named by a
+// hash of their inputs, so that entries are invalidated automatically when the inputs change
+// (an empty dirname disables the cache)
+void set_asset_cache(const string& dirname);
+// whether the cache is enabled
+bool asset_cache_enabled();
+// cache file name for a key and extension (empty if the cache is disabled)
+string asset_cache_filename(uint64_t key, const string& ext);
+// whether a cache entry exists and can be read (unreadable entries are removed, so they are rebuilt)
+bool asset_cache_contains(const string& filename);
+// temporary name used to write a cache entry, then moved in place with asset_cache_commit
+string asset_cache_tmpname(const string& filename);
+void asset_cache_commit(const string& tmpname, const string& filename);
+
+// read the section table of a binary file without reading its data
+vector<BinarySection> read_binary_sections(const string& filename);
+// whether a file has a well-formed header and section table, without stopping on errors;
+// otherwise msg describes the problem
+bool check_binary_file(const string& filename, string& msg);
+
+// binary file writer that collects sections and writes them at once
+struct BinaryWriter {
+    // add a section of elements of type T made of N values of type E
+    template<typename E, int N, typename T>
+    void add(const string& name, const vector<T>& value) {
+        static_assert(sizeof(T) == sizeof(E)*N, "wrong element size");
+        if(value.empty()) return;
+        _add(name, BinaryFile::_type<E>(), N, value.size(), 1, value.data());
+    }
+    // add a section split in rows of equal size
+    template<typename E, int N, typename T>
+    void add(const string& name, const vector<vector<T>>& value) {
+        static_assert(sizeof(T) == sizeof(E)*N, "wrong element size");
+        if(value.empty()) return;
+        auto data = vector<T>();
+        for(auto& row : value) {
+            error_if_not(row.size() == value[0].size(), "rows of different size in section %s\n", name.c_str());
+            data.insert(data.end(), row.begin(), row.end());
+        }
+        _add(name, BinaryFile::_type<E>(), N, data.size(), value.size(), data.data());
+    }
+    // add a vector of bools as bytes
+    void add(const string& name, const vector<bool>& value);
+    // add a text section
+    void add_text(const string& name, const string& text);
+
+    // write all sections to a file
+    void save(const string& filename) const;
+
+    vector<BinarySection>   _sections;  // section table (offsets are relative to the data block)
+    string                  _data;      // section data
+
+    // add a section
+    void _add(const string& name, uint32_t type, int components, size_t count, size_t rows, const void* data);
+};
+
+#endif
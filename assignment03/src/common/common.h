@@ -11,6 +11,8 @@
 #include <fstream>
 #include <cstdio>
 #include <typeinfo>
+#include <thread>
+#include <algorithm>
 
 // bringing stand libraray objects in scope
 using std::string;
@@ -59,6 +61,21 @@ struct range {
     iterator end() { return iterator(max); }
 };
 
+// runs f(start,end) over contiguous chunks of [0,count) on all hardware threads
+// To use:
+//     parallel_for(n, [&](int start, int end){ for(auto i : range(start,end)) { ... } });
+template<typename F>
+inline void parallel_for(int count, const F& f, int min_chunk = 1024) {
+    auto nthreads = (int)std::max(1u,std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, (count+min_chunk-1) / std::max(min_chunk,1));
+    if(nthreads <= 1) { if(count > 0) f(0,count); return; }
+    auto threads = vector<std::thread>();
+    for(auto t : range(nthreads)) {
+        threads.push_back(std::thread([&f,t,nthreads,count](){ f(count*t/nthreads, count*(t+1)/nthreads); }));
+    }
+    for(auto& thread : threads) thread.join();
+}
+
 // load a text file into a buffer
 inline string load_text_file(const char* filename) {
     auto text = string("");
@@ -70,4 +87,16 @@ inline string load_text_file(const char* filename) {
     return text;
 }
 
+// load a whole file in memory as bytes
+inline string load_binary_file(const string& filename) {
+    auto f = fopen(filename.c_str(),"rb");
+    error_if_not(f, "cannot open file: %s\n", filename.c_str());
+    fseek(f, 0, SEEK_END);
+    auto data = string(ftell(f), 0);
+    fseek(f, 0, SEEK_SET);
+    error_if_not(fread(&data[0], 1, data.size(), f) == data.size(), "cannot read file: %s\n", filename.c_str());
+    fclose(f);
+    return data;
+}
+
 #endif
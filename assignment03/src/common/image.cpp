@@ -1,107 +1,233 @@
 #include "image.h"
+#include "binary.h"
 #include "lodepng.h"
 
-static void _read_pnm(const string& filename, char& type,
-               int& width, int& height, int& nc,
-               float& scale, unsigned char*& buffer) {
-    char identifier[4]; 
-    bool ascii = false;
-    
-    FILE *f = fopen(filename.c_str(), "rb");
-    if (f == 0) {
-        error_if_not(f != 0, "failed to open image file %s", filename.c_str());
-        nc = width = height = 0;
-        buffer = nullptr;
-        return;
+#include <condition_variable>
+#include <mutex>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <cctype>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// pow(x,g) as exp2(g*log2(x)), with polynomial log2 and exp2 written without branches or
+// calls so that loops over it vectorize (relative error below 3e-6); x must be zero or a
+// normal float with g*log2(x) in [-126,126]
+static inline float _fast_pow(float x, float g) {
+    // x = m * 2^e with m in [sqrt(1/2), sqrt(2))
+    int32_t bits; memcpy(&bits, &x, 4);
+    auto e = (bits - 0x3f3504f3) >> 23;
+    auto mbits = bits - e * (1 << 23);
+    float m; memcpy(&m, &mbits, 4);
+    // log2(m) from the series of atanh((m-1)/(m+1))
+    auto t = (m - 1) / (m + 1), t2 = t*t;
+    auto y = g * (e + t * (2.885390082f + t2 * (0.961796694f + t2 * (0.577078017f + t2 * 0.412198583f))));
+    // exp2 of the rounded integer part by exponent bits, of the rest by a polynomial
+    auto n = (int32_t)(y + ((y >= 0) ? 0.5f : -0.5f));
+    auto f = y - n;
+    auto p = 1 + f*(0.693147181f + f*(0.240226507f + f*(0.0555041087f + f*(0.00961812911f + f*(0.00133335581f + f*0.000154035304f)))));
+    int32_t pbits; memcpy(&pbits, &p, 4);
+    pbits += n * (1 << 23);
+    // zero for zero, masking bits since selects stop the vectorizer
+    pbits &= -(int32_t)(x > 0);
+    float r; memcpy(&r, &pbits, 4);
+    return r;
+}
+
+// number of values in a row, other than zero, outside [lo,hi]
+static int _count_outside(const float* row, int n, float lo, float hi) {
+    auto count = 0;
+    for(auto i : range(n)) count += (row[i] != 0) & ((row[i] < lo) | (row[i] > hi));
+    return count;
+}
+
+// _fast_pow over a row (kept out of line so that the loop vectorizes)
+static void _fast_pow_row(float* row, int n, float gamma) {
+    for(auto i : range(n)) row[i] = _fast_pow(row[i],gamma);
+}
+
+template<>
+void image3f::gamma_inplace(float gamma) {
+    if(gamma == 1) return;
+    auto d = (float*)data();
+    auto n = _w*3;
+    // inputs for which _fast_pow stays within the normal float range (none for negative gammas)
+    auto lo = (gamma > 0) ? max(FLT_MIN, exp2(-126/gamma)) : 1.0f;
+    auto hi = (gamma > 0) ? exp2(126/gamma) : 0.0f;
+    parallel_for(_h, [d,n,gamma,lo,hi](int start, int end){
+        for(auto j : range(start,end)) {
+            auto row = d + j*n;
+            // exact shortcuts for the common square and square root
+            if(gamma == 2) { for(auto i : range(n)) row[i] = row[i]*row[i]; continue; }
+            if(gamma == 0.5f) { for(auto i : range(n)) row[i] = sqrt(row[i]); continue; }
+            // rows with values out of the range of _fast_pow (other than zero) use the exact pow
+            if(not _count_outside(row,n,lo,hi)) _fast_pow_row(row,n,gamma);
+            else for(auto i : range(n)) row[i] = pow(row[i],gamma);
+        }
+    }, 64);
+}
+
+template<>
+void image3f::scale_inplace(float s) {
+    auto d = (float*)data();
+    auto n = _w*3;
+    parallel_for(_h, [d,n,s](int start, int end){
+        for(auto i : range(start*n,end*n)) d[i] *= s;
+    }, 64);
+}
+
+// pnm/pfm file header
+struct _PnmHeader {
+    char    type = 0;           // 'f' for floats, 'B' for bytes
+    int     nc = 0;             // number of channels
+    bool    ascii = false;      // whether values are written as text
+    int     width = 0;          // image width
+    int     height = 0;         // image height
+    float   scale = 1;          // scale applied to values
+    bool    big_endian = false; // whether floats are big-endian
+    size_t  offset = 0;         // offset of the pixel data
+};
+
+// next header token, skipping whitespace and comments
+static string _pnm_token(const char* data, size_t size, size_t& pos) {
+    while(pos < size) {
+        if(data[pos] == '#') { while(pos < size and data[pos] != '\n') pos ++; }
+        else if(isspace((unsigned char)data[pos])) pos ++;
+        else break;
     }
+    auto start = pos;
+    while(pos < size and not isspace((unsigned char)data[pos])) pos ++;
+    return string(data + start, pos - start);
+}
+
+// parse the header of a pnm/pfm file in memory; returns the problem found, if any (empty otherwise)
+static string _check_pnm_header(const char* data, size_t size, const string& filename, _PnmHeader& header) {
+    header = _PnmHeader();
+    auto pos = (size_t)0;
+    auto id = _pnm_token(data, size, pos);
+    if("Pf" == id) { header.nc = 1; header.ascii = false; header.type = 'f'; }
+    else if ("PF"  == id) { header.nc = 3; header.ascii = false; header.type = 'f'; }
+    else if ("P2"  == id) { header.nc = 1; header.ascii = true; header.type = 'B'; }
+    else if ("P3"  == id) { header.nc = 3; header.ascii = true; header.type = 'B'; }
+    else if ("P5"  == id) { header.nc = 1; header.ascii = false; header.type = 'B'; }
+    else if ("P6"  == id) { header.nc = 3; header.ascii = false; header.type = 'B'; }
+    else return tostring("unknown image format in file %s", filename.c_str());
     
-    error_if_not(fscanf(f, "%s", identifier) == 1, "error reading image file");
-    string id = identifier;
-    
-    if("Pf" == id) { nc = 1; ascii = false; type = 'f'; }
-    else if ("PF"  == id) { nc = 3; ascii = false; type = 'f'; }
-    else if ("P2"  == id) { nc = 1; ascii = true; type = 'B'; }
-    else if ("P3"  == id) { nc = 3; ascii = true; type = 'B'; }
-    else if ("P5"  == id) { nc = 1; ascii = false; type = 'B'; }
-    else if ("P6"  == id) { nc = 3; ascii = false; type = 'B'; }
-    else {	error("unknown image format"); }
-    
-    error_if_not(fscanf(f, "%d%d\n", &width, &height) == 2, "error reading image file %s", filename.c_str());
-    if(type == 'B') { 
-        buffer = new unsigned char[width*height*nc]; 
-        int maxv;
-        error_if_not(fscanf(f, "%d\n", &maxv) == 1, "error reading image file %s", filename.c_str());
-        error_if_not(maxv == 255, "unsupported max value");
-        scale = 1.0f / maxv;
-        if(!ascii) {
-            int bread = (int)fread(buffer, sizeof(unsigned char), width*height*nc, f);
-            error_if_not(bread == width*height*nc, "error reading image file %s", filename.c_str());
-        } else {
-            unsigned char* buf = (unsigned char*)buffer;
-            for(int i = 0; i < width*height*nc; i ++) {
-                int v;
-                error_if_not(fscanf(f, "%d", &v) == 1, "error reading image file %s", filename.c_str());
-                buf[i] = (unsigned char)v;
-            }
-        }
-    } else if(type == 'f') { 
-        buffer = (unsigned char*)(new float[width*height*nc]);
-        char scale_string[16];
-        error_if_not(fgets(scale_string, 16, f) == scale_string, "error reading with fgets, file %s", filename.c_str());
-        sscanf(scale_string, "%f\n", &scale);
-        error_if_not(scale < 0, "only support little endian pfm");
-        scale = abs(scale);
-        // flip y while reading
-        for(int j = height-1; j >= 0; j --) {
-            float* buf = (float*)buffer;
-            int bytes = (int)fread(buf + (j*width*nc), sizeof(float), width*nc, f);
-            error_if_not(bytes == width*nc, "error reading image file");
+    header.width = atoi(_pnm_token(data, size, pos).c_str());
+    header.height = atoi(_pnm_token(data, size, pos).c_str());
+    if(header.width <= 0 or header.height <= 0) return tostring("error reading image file %s", filename.c_str());
+    auto scale = _pnm_token(data, size, pos);
+    if(header.type == 'B') {
+        if(atoi(scale.c_str()) != 255) return "unsupported max value";
+        header.scale = 1.0f / 255;
+    } else {
+        // the sign of the scale gives the endianness
+        header.scale = (float)atof(scale.c_str());
+        if(header.scale == 0) return tostring("error reading image file %s", filename.c_str());
+        header.big_endian = header.scale > 0;
+        header.scale = abs(header.scale);
+    }
+    // a single whitespace separates the header from the data
+    header.offset = pos + 1;
+    return string();
+}
+
+// parse the header of a pnm/pfm file in memory
+static _PnmHeader _parse_pnm_header(const char* data, size_t size, const string& filename) {
+    auto header = _PnmHeader();
+    auto msg = _check_pnm_header(data, size, filename, header);
+    error_if_not(msg.empty(), "%s", msg.c_str());
+    return header;
+}
+
+// whether the machine stores floats as big-endian
+static bool _is_big_endian() { auto one = (uint32_t)1; return *(char*)&one == 0; }
+
+// convert a row of n floats stored as bytes, swapping their bytes if needed, and scale them
+static void _convert_float_row(const unsigned char* src, float* dst, int n, float scale, bool swap) {
+    if(swap) {
+        for(auto i : range(n)) {
+            auto s = src + i*4;
+            auto bits = (uint32_t)s[3] | ((uint32_t)s[2] << 8) | ((uint32_t)s[1] << 16) | ((uint32_t)s[0] << 24);
+            auto v = 0.0f; memcpy(&v, &bits, 4);
+            dst[i] = v * scale;
         }
-    } else error("unknown type");
-    
-    fclose(f);
+    } else {
+        memcpy(dst, src, n*4);
+        for(auto i : range(n)) dst[i] *= scale;
+    }
+}
+
+// convert a row of n bytes to scaled floats
+static void _convert_byte_row(const unsigned char* src, float* dst, int n, float scale) {
+    for(auto i : range(n)) dst[i] = src[i] * scale;
 }
 
 image3f read_pnm(const string& filename, bool flipY) {
-    int width, height, nc; float scale; unsigned char* buffer; char type;
-    _read_pnm(filename, type, width, height, nc, scale, buffer);
-    if (not buffer) {
-        error_if_not(false, "failed to load image file %s", filename.c_str());
-        return image3f();
-    }
-    error_if_not(nc == 3 && (type == 'f' || type == 'B'), "unsupported image format in file %s", filename.c_str());
+    // the file is mapped and converted straight into the image, so large images are not copied
+    auto file = MappedFile(filename, true);
+    auto header = _parse_pnm_header(file._data, file._size, filename);
+    error_if_not(header.nc == 3, "unsupported image format in file %s", filename.c_str());
     
-    image3f img(width,height);
-    if(type == 'f') {
-        float* buf = (float*)buffer;
-        for(int i = 0; i < img.width()*img.height(); i ++) {
-            img.data()[i] = vec3f(buf[i*3+0],buf[i*3+1],buf[i*3+2]) * scale;
+    auto img = image3f(header.width,header.height);
+    auto n = header.width*3;
+    auto dst = (float*)img.data();
+    // pfm rows are stored bottom to top, so the flip is folded in the row order
+    auto bottom_up = (header.type == 'f') != flipY;
+    auto height = header.height;
+    if(header.ascii) {
+        // values are parsed in sequence from the mapped text
+        auto text = file._data;
+        auto pos = header.offset - 1;
+        for(auto k : range(height)) {
+            auto row = dst + ((bottom_up) ? height-1-k : k)*n;
+            for(auto i : range(n)) {
+                while(pos < file._size and isspace((unsigned char)text[pos])) pos ++;
+                error_if_not(pos < file._size and isdigit((unsigned char)text[pos]), "error reading image file %s", filename.c_str());
+                auto v = 0;
+                while(pos < file._size and isdigit((unsigned char)text[pos])) v = v*10 + (text[pos++] - '0');
+                row[i] = (unsigned char)v * header.scale;
+            }
         }
-    } else if(type == 'B') {
-        unsigned char* buf = (unsigned char*)buffer;
-        for(int i = 0; i < img.width()*img.height(); i ++) {
-            img.data()[i] = vec3f((float)buf[i*3+0],(float)buf[i*3+1],(float)buf[i*3+2]) * scale;
-        }        
+    } else {
+        auto ds = (header.type == 'f') ? 4 : 1;
+        error_if_not(header.offset + (size_t)height*n*ds <= file._size, "error reading image file %s", filename.c_str());
+        auto src = (const unsigned char*)file._data + header.offset;
+        auto swap = header.big_endian != _is_big_endian();
+        auto type = header.type;
+        auto scale = header.scale;
+        parallel_for(height, [src,dst,n,ds,height,bottom_up,type,scale,swap](int start, int end){
+            for(auto k : range(start,end)) {
+                auto row = dst + ((bottom_up) ? height-1-k : k)*n;
+                if(type == 'f') _convert_float_row(src + (size_t)k*n*ds, row, n, scale, swap);
+                else _convert_byte_row(src + (size_t)k*n*ds, row, n, scale);
+            }
+        }, 64);
     }
-    if (buffer) delete [] buffer;
-    
-    if(flipY) img = img.flipy();
-    
     return img;
 }
 
 static void _write_pnm(const char *filename, char type,
                          int width, int height, int nc,
-                         bool ascii, unsigned char* buffer) {
+                         bool ascii, bool flipY, const unsigned char* buffer) {
     FILE *f = fopen(filename, "wb");
     error_if_not(f != 0, "failed to create image file %s", filename);
     
     string magic; 
     int scale = -1; 
     int ds = 0;
-    if(type == 'f' && nc == 1 && !ascii) { magic = "Pf"; scale = -1; 
+    // floats are written as stored, with the sign of the scale giving their endianness
+    int fscale = (_is_big_endian()) ? 1 : -1;
+    if(type == 'f' && nc == 1 && !ascii) { magic = "Pf"; scale = fscale; 
         ds = sizeof(float); }
-    else if(type == 'f' && nc == 3 && !ascii) { magic = "PF"; scale = -1; 
+    else if(type == 'f' && nc == 3 && !ascii) { magic = "PF"; scale = fscale; 
         ds = sizeof(float); }
     else if(type == 'B' && nc == 1 && !ascii) { magic = "P5"; scale = 255; 
         ds = sizeof(unsigned char); }
@@ -118,19 +244,20 @@ static void _write_pnm(const char *filename, char type,
     error_if_not(fprintf(f, "%d\n", scale) > 0, "error writing file %s", filename);
     
     if(!ascii) {
-        if(type == 'f') {
-            for(int j = height-1; j >= 0; j --) {
-                float* buf = (float*)buffer;
-                error_if_not((int)fwrite(buf + j*width*nc, ds, width*nc, f) == width*nc, "error writing file %s", filename);
-            }
-        } else {
-            error_if_not((int)fwrite(buffer, ds, width*height*nc, f) == width*height*nc, "error writing file %s", filename);
+        // pfm rows are stored bottom to top, so flipping writes them in memory order
+        auto bottom_up = (type == 'f') != flipY;
+        for(int k = 0; k < height; k ++) {
+            int j = (bottom_up) ? height-1-k : k;
+            error_if_not((int)fwrite(buffer + j*width*nc*ds, ds, width*nc, f) == width*nc, "error writing file %s", filename);
         }
     } else {
-        unsigned char* buf = (unsigned char*)buffer;
-        for(int i = 0; i < width*height*nc; i ++) {
-            int v = buf[i];
-            error_if_not(fprintf(f, "%d \n", v) != 0, "error writing file %s", filename);
+        // values are formatted a row at a time
+        auto text = string();
+        for(int k = 0; k < height; k ++) {
+            int j = (flipY) ? height-1-k : k;
+            text.clear();
+            for(int i = 0; i < width*nc; i ++) { text += std::to_string(buffer[j*width*nc+i]); text += " \n"; }
+            error_if_not(fwrite(text.data(), 1, text.size(), f) == text.size(), "error writing file %s", filename);
         }
     }
     
@@ -138,18 +265,21 @@ static void _write_pnm(const char *filename, char type,
 }
 
 void write_pfm(const string& filename, const image3f& img, bool flipY) {
-    _write_pnm(filename.c_str(), 'f', img.width(), img.height(), 3, false,
-               (flipY)?(unsigned char*)img.flipy().data():(unsigned char*)img.data());
+    _write_pnm(filename.c_str(), 'f', img.width(), img.height(), 3, false, flipY, (const unsigned char*)img.data());
 }
 
-image3f read_png(const string& filename, bool flipY) {
-    vector<unsigned char> pixels;
-    unsigned width, height;
-    
+// decode a png file to 8-bit rgba
+static void _decode_png(const string& filename, vector<unsigned char>& pixels, unsigned& width, unsigned& height) {
     unsigned error = lodepng::decode(pixels, width, height, filename);
     error_if_not(not error,"cannot read png image: %s", filename.c_str());
     
     error_if_not(pixels.size() == width*height*4, "bad reading");
+}
+
+image3f read_png(const string& filename, bool flipY) {
+    vector<unsigned char> pixels;
+    unsigned width, height;
+    _decode_png(filename, pixels, width, height);
     
     image3f img(width,height);
     for(int i = 0; i < width*height; i ++) {
@@ -164,18 +294,350 @@ image3f read_png(const string& filename, bool flipY) {
     return img;
 }
 
-void write_png(const string& filename, const image3f& img, bool flipY) {
-    vector<unsigned char> img_png(img.width()*img.height()*4);
-    for(int x = 0; x < img.width(); x++ ) {
-        for( int y = 0; y < img.height(); y++ ) {
-            int i_img = y * img.width() + x;
-            int i_png = ( ( flipY ? (img.height()-1-y) : y ) * img.width() + x ) * 4;
-            img_png[i_png+0] = (unsigned char)clamp(img.data()[i_img].x * 255, 0.0f, 255.0f);
-            img_png[i_png+1] = (unsigned char)clamp(img.data()[i_img].y * 255, 0.0f, 255.0f);
-            img_png[i_png+2] = (unsigned char)clamp(img.data()[i_img].z * 255, 0.0f, 255.0f);
-            img_png[i_png+3] = 255;
+image4b read_png4b(const string& filename, bool flipY) {
+    vector<unsigned char> pixels;
+    unsigned width, height;
+    _decode_png(filename, pixels, width, height);
+    
+    // lodepng rgba bytes have the layout of rgba8, so rows are copied as they are
+    image4b img(width,height);
+    for(auto y : range((int)height)) {
+        memcpy(&img.at(0,(flipY) ? height-y-1 : y), pixels.data() + y*width*4, width*4);
+    }
+    return img;
+}
+
+// convert an image to 8-bit rgb or rgba rows (nc components), in bands of rows on all threads
+// (or on the calling one, when it is one of many already running)
+static void _image_to_bytes(const image3f& img, bool flipY, int nc, vector<unsigned char>& bytes, bool parallel) {
+    bytes.resize(img.width()*img.height()*nc);
+    auto convert = [&img,flipY,nc,&bytes](int start, int end){
+        for(auto y : range(start,end)) {
+            auto src = img.data() + y*img.width();
+            auto dst = bytes.data() + (flipY ? img.height()-1-y : y)*img.width()*nc;
+            for(auto x : range(img.width())) {
+                dst[x*nc+0] = (unsigned char)clamp(src[x].x * 255, 0.0f, 255.0f);
+                dst[x*nc+1] = (unsigned char)clamp(src[x].y * 255, 0.0f, 255.0f);
+                dst[x*nc+2] = (unsigned char)clamp(src[x].z * 255, 0.0f, 255.0f);
+                if(nc == 4) dst[x*nc+3] = 255;
+            }
         }
+    };
+    if(parallel) parallel_for(img.height(), convert, 64);
+    else convert(0, img.height());
+}
+
+// encode and save a png, converting the image on all threads if parallel
+static void _write_png(const string& filename, const image3f& img, bool flipY, bool fast, bool parallel) {
+    auto nc = (fast) ? 3 : 4;
+    auto pixels = vector<unsigned char>();
+    _image_to_bytes(img, flipY, nc, pixels, parallel);
+    auto state = lodepng::State();
+    state.info_raw.colortype = (fast) ? LCT_RGB : LCT_RGBA;
+    state.info_raw.bitdepth = 8;
+    if(fast) {
+        // store rgb as given (no scan for a smaller color type), with one cheap filter
+        // for all rows and a short lz77 window
+        state.encoder.auto_convert = LAC_NO;
+        state.info_png.color.colortype = LCT_RGB;
+        state.info_png.color.bitdepth = 8;
+        state.encoder.filter_strategy = LFS_ZERO;
+        state.encoder.zlibsettings.windowsize = 256;
     }
-    unsigned error = lodepng::encode(filename, img_png, img.width(), img.height());
+    auto png = vector<unsigned char>();
+    auto error = lodepng::encode(png, pixels, img.width(), img.height(), state);
     error_if_not(not error, "cannot write png image: %s", filename.c_str());
+    error = lodepng_save_file(png.data(), png.size(), filename.c_str());
+    error_if_not(not error, "cannot write png image: %s", filename.c_str());
+}
+
+void write_png(const string& filename, const image3f& img, bool flipY, bool fast) {
+    _write_png(filename, img, flipY, fast, true);
+}
+
+ImageWriter::ImageWriter(int nthreads, int max_queued) : _max_queued(max(1,max_queued)) {
+    if(nthreads <= 0) nthreads = max(1, (int)std::thread::hardware_concurrency()-1);
+    for(auto i = 0; i < nthreads; i ++) _threads.push_back(std::thread([this](){ _run(); }));
+}
+
+ImageWriter::~ImageWriter() {
+    wait();
+    { std::lock_guard<std::mutex> lock(_mutex); _stop = true; }
+    _wakeup.notify_all();
+    for(auto& thread : _threads) thread.join();
+}
+
+void ImageWriter::write_png(const string& filename, image3f&& img, bool flipY, bool fast) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this](){ return (int)_queue.size() < _max_queued; });
+    _queue.push_back(_Job{filename, std::move(img), flipY, fast});
+    _wakeup.notify_one();
+}
+
+void ImageWriter::wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this](){ return _queue.empty() and not _busy; });
+}
+
+void ImageWriter::_run() {
+    while(true) {
+        auto job = _Job();
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeup.wait(lock, [this](){ return _stop or not _queue.empty(); });
+            if(_queue.empty()) return;
+            job = std::move(_queue.front());
+            _queue.pop_front();
+            _busy ++;
+        }
+        // the writer threads already use all cores, so each image is converted serially
+        _write_png(job.filename, job.img, job.flipY, job.fast, false);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _busy --;
+        }
+        _done.notify_all();
+    }
+}
+
+VideoWriter::VideoWriter(const string& filename, int width, int height, float fps, bool y4m) :
+    _y4m(y4m), _width(width), _height(height) {
+    if(filename == "-") {
+        // keep the real standard output for the stream and send everything else to the standard error
+        fflush(stdout);
+#ifdef _WIN32
+        auto fd = _dup(_fileno(stdout));
+        _dup2(_fileno(stderr), _fileno(stdout));
+        _setmode(fd, _O_BINARY);
+        _file = _fdopen(fd, "wb");
+#else
+        auto fd = dup(fileno(stdout));
+        dup2(fileno(stderr), fileno(stdout));
+        _file = fdopen(fd, "wb");
+#endif
+    } else _file = fopen(filename.c_str(), "wb");
+    error_if_not(_file, "cannot open video stream: %s\n", filename.c_str());
+    if(_y4m) fprintf(_file, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg\n", width, height, (int)round(fps*1000));
+}
+
+VideoWriter::~VideoWriter() {
+    fclose(_file);
+}
+
+// convert an image to the planes of a YUV 4:2:0 frame (bt.601, video range), two rows of luma
+// and one of chroma at a time on all threads; the loops over rows are written to vectorize
+static void _image_to_yuv420(const image3f& img, bool flipY, unsigned char* y, unsigned char* u, unsigned char* v) {
+    auto w = img.width(), h = img.height(), cw = (w+1)/2, ch = (h+1)/2;
+    parallel_for(ch, [&](int start, int end){
+        auto r = vector<float>(w*2), g = vector<float>(w*2), b = vector<float>(w*2);
+        for(auto cj : range(start,end)) {
+            // clamped colors of the two source rows (the last row repeats for odd heights)
+            for(auto k : range(2)) {
+                auto j = min(cj*2+k, h-1);
+                auto src = img.data() + ((flipY) ? h-1-j : j)*w;
+                for(auto i : range(w)) {
+                    r[k*w+i] = min(max(src[i].x, 0.0f), 1.0f);
+                    g[k*w+i] = min(max(src[i].y, 0.0f), 1.0f);
+                    b[k*w+i] = min(max(src[i].z, 0.0f), 1.0f);
+                }
+            }
+            // luma
+            for(auto k : range(min(2, h-cj*2))) {
+                auto dst = y + (cj*2+k)*w;
+                auto rk = r.data() + k*w, gk = g.data() + k*w, bk = b.data() + k*w;
+                for(auto i : range(w)) dst[i] = (unsigned char)(16.5f + 65.481f*rk[i] + 128.553f*gk[i] + 24.966f*bk[i]);
+            }
+            // chroma of the average of each 2x2 block (the last column repeats for odd widths)
+            for(auto ci : range(cw)) {
+                auto i0 = ci*2, i1 = min(ci*2+1, w-1);
+                auto ra = 0.25f * (r[i0] + r[i1] + r[w+i0] + r[w+i1]);
+                auto ga = 0.25f * (g[i0] + g[i1] + g[w+i0] + g[w+i1]);
+                auto ba = 0.25f * (b[i0] + b[i1] + b[w+i0] + b[w+i1]);
+                u[cj*cw+ci] = (unsigned char)(128.5f - 37.797f*ra - 74.203f*ga + 112.0f*ba);
+                v[cj*cw+ci] = (unsigned char)(128.5f + 112.0f*ra - 93.786f*ga - 18.214f*ba);
+            }
+        }
+    }, 16);
+}
+
+void VideoWriter::write_frame(const image3f& img, bool flipY) {
+    error_if_not(img.width() == _width and img.height() == _height, "wrong video frame size %dx%d\n", img.width(), img.height());
+    if(_y4m) {
+        auto size = _width*_height, csize = ((_width+1)/2)*((_height+1)/2);
+        _frame.resize(size + 2*csize);
+        _image_to_yuv420(img, flipY, _frame.data(), _frame.data()+size, _frame.data()+size+csize);
+        fputs("FRAME\n", _file);
+    } else _image_to_bytes(img, flipY, 3, _frame, true);
+    error_if_not(fwrite(_frame.data(), 1, _frame.size(), _file) == _frame.size(), "cannot write video frame\n");
+}
+
+// texture cache entry
+struct _TextureEntry {
+    Texture*    image = nullptr;    // decoded image (nullptr while decoding)
+    int         refs = 0;           // number of references
+};
+
+static map<string,_TextureEntry>    _texture_cache;         // textures by canonical path
+static map<Texture*,string>         _texture_paths;         // canonical path of each texture
+static std::mutex                   _texture_mutex;         // guards the cache
+static std::condition_variable      _texture_decoded;       // signals that a texture was decoded
+static bool                         _texture_half_float = false;   // whether pfm textures are stored as half floats
+
+// canonical path of a file, so that different relative paths share an image
+static string _canonical_path(const string& filename) {
+#ifdef _WIN32
+    char buf[4096];
+    return (_fullpath(buf, filename.c_str(), sizeof(buf))) ? string(buf) : filename;
+#else
+    auto path = realpath(filename.c_str(), nullptr);
+    if(not path) return filename;
+    auto canonical = string(path);
+    free(path);
+    return canonical;
+#endif
+}
+
+vector<unsigned char> Texture::level_data(int l) const {
+    auto data = vector<unsigned char>(level_width(l)*level_height(l)*((format == texture_rgba8) ? sizeof(rgba8) : (format == texture_rgb16f) ? sizeof(rgb16f) : sizeof(vec3f)));
+    if(format == texture_rgba8) { auto img = mips4b.level_image(l); memcpy(data.data(), img.data(), data.size()); }
+    else if(format == texture_rgb16f) { auto img = mips3h.level_image(l); memcpy(data.data(), img.data(), data.size()); }
+    else { auto img = mips3f.level_image(l); memcpy(data.data(), img.data(), data.size()); }
+    return data;
+}
+
+// version of the mip chain layout, part of the cache key of textures
+#define MIPCHAIN_VERSION 1
+
+// save a mip chain made of pixels of N values of type E to a cache entry
+template<typename E, int N, typename P>
+static void _save_mips(const string& filename, const mipchain<P>& mips) {
+    auto bin = BinaryWriter();
+    bin.add<int,4>("mips.levels", mips.levels);
+    bin.add<E,N>("mips.data", mips.data);
+    bin.save(filename);
+}
+
+// load a mip chain from a cache entry
+template<typename E, int N, typename P>
+static void _load_mips(const string& filename, mipchain<P>& mips) {
+    auto bin = BinaryFile(filename);
+    bin.read<int,4>("mips.levels", mips.levels);
+    bin.read<E,N>("mips.data", mips.data);
+}
+
+// decode a texture from a PFM or PNG file and build its mip chain, or load it from the asset cache
+static Texture* _decode_texture(const string& filename, bool half_float) {
+    auto ext = filename.substr(filename.size()-3);
+    auto txt = new Texture();
+    if(ext == "pfm") txt->format = (half_float) ? texture_rgb16f : texture_rgb32f;
+    else if(ext == "png") txt->format = texture_rgba8;
+    else error("unsupported image format %s\n", ext.c_str());
+    // cache entries are keyed by the file contents and the storage format
+    auto cachename = string();
+    if(asset_cache_enabled()) {
+        auto file = MappedFile(filename);
+        auto key = hash_value((int)MIPCHAIN_VERSION, hash_value((int)txt->format, hash_bytes(file._data, file._size)));
+        cachename = asset_cache_filename(hash_value((int)BINARY_VERSION, key), "mips.bin");
+    }
+    auto cached = not cachename.empty() and asset_cache_contains(cachename);
+    if(txt->format == texture_rgba8) {
+        if(cached) _load_mips<char,4>(cachename, txt->mips4b);
+        else txt->mips4b.build(read_png4b(filename, true));
+    } else {
+        if(cached and txt->format == texture_rgb16f) _load_mips<char,6>(cachename, txt->mips3h);
+        else if(cached) _load_mips<float,3>(cachename, txt->mips3f);
+        else {
+            auto img = read_pnm(filename, true);
+            img.gamma_inplace(1/2.2);
+            if(txt->format == texture_rgb16f) txt->mips3h.build(convert_image<rgb16f>(img));
+            else txt->mips3f.build(img);
+        }
+    }
+    if(not cachename.empty() and not cached) {
+        auto tmpname = asset_cache_tmpname(cachename);
+        if(txt->format == texture_rgba8) _save_mips<char,4>(tmpname, txt->mips4b);
+        else if(txt->format == texture_rgb16f) _save_mips<char,6>(tmpname, txt->mips3h);
+        else _save_mips<float,3>(tmpname, txt->mips3f);
+        asset_cache_commit(tmpname, cachename);
+    }
+    return txt;
+}
+
+void set_texture_half_float(bool half_float) {
+    std::lock_guard<std::mutex> lock(_texture_mutex);
+    _texture_half_float = half_float;
+}
+
+Texture* acquire_texture(const string& filename) {
+    auto path = _canonical_path(filename);
+    std::unique_lock<std::mutex> lock(_texture_mutex);
+    auto& entry = _texture_cache[path];
+    entry.refs ++;
+    if(entry.refs > 1) {
+        // already decoded or being decoded by another thread
+        _texture_decoded.wait(lock, [&entry](){ return entry.image != nullptr; });
+        return entry.image;
+    }
+    // decode outside the lock, so other textures decode concurrently
+    auto half_float = _texture_half_float;
+    lock.unlock();
+    auto image = _decode_texture(path, half_float);
+    lock.lock();
+    entry.image = image;
+    _texture_paths[image] = path;
+    _texture_decoded.notify_all();
+    return image;
+}
+
+void release_texture(Texture* txt) {
+    if(not txt) return;
+    std::lock_guard<std::mutex> lock(_texture_mutex);
+    auto path = _texture_paths.find(txt);
+    error_if_not(path != _texture_paths.end(), "releasing a texture not in the cache\n");
+    auto entry = _texture_cache.find(path->second);
+    if(-- entry->second.refs > 0) return;
+    delete entry->second.image;
+    _texture_cache.erase(entry);
+    _texture_paths.erase(path);
+}
+
+string texture_filename(Texture* txt) {
+    std::lock_guard<std::mutex> lock(_texture_mutex);
+    auto path = _texture_paths.find(txt);
+    return (path != _texture_paths.end()) ? path->second : string();
+}
+
+void reload_texture(Texture* txt) {
+    auto path = texture_filename(txt);
+    error_if_not(not path.empty(), "reloading a texture not in the cache\n");
+    auto image = _decode_texture(path, txt->format == texture_rgb16f);
+    std::lock_guard<std::mutex> lock(_texture_mutex);
+    *txt = std::move(*image);
+    delete image;
+}
+
+bool check_texture_file(const string& filename, string& msg) {
+    auto f = fopen(filename.c_str(), "rb");
+    if(not f) { msg = tostring("cannot open file: %s", filename.c_str()); return false; }
+    fseek(f, 0, SEEK_END);
+    auto size = (size_t)ftell(f);
+    fclose(f);
+    auto ext = (filename.size() >= 3) ? filename.substr(filename.size()-3) : string();
+    if(ext == "png") {
+        // only decoding finds truncated or corrupted data
+        auto pixels = vector<unsigned char>();
+        auto width = 0u, height = 0u;
+        auto error = lodepng::decode(pixels, width, height, filename);
+        if(error) msg = tostring("cannot read png image: %s (%s)", filename.c_str(), lodepng_error_text(error));
+        return not error;
+    }
+    if(ext != "pfm") { msg = tostring("unsupported image format %s", ext.c_str()); return false; }
+    if(size == 0) { msg = tostring("error reading image file %s", filename.c_str()); return false; }
+    // pfm data is binary, so checking the header and the file size suffices
+    auto file = MappedFile(filename);
+    auto header = _PnmHeader();
+    msg = _check_pnm_header(file._data, file._size, filename, header);
+    if(msg.empty() and header.nc != 3) msg = tostring("unsupported image format in file %s", filename.c_str());
+    if(msg.empty() and header.offset + (size_t)header.width*header.height*3*4 > size) msg = tostring("error reading image file %s", filename.c_str());
+    return msg.empty();
 }
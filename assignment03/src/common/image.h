@@ -4,16 +4,72 @@
 #include "common.h"
 #include "vmath.h"
 
-// A generic image
-struct image3f {
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+// 8-bit rgba pixel (alpha pads pixels to 4 bytes, so rows are aligned for upload)
+struct rgba8 {
+    unsigned char r = 0, g = 0, b = 0, a = 255;
+};
+
+// half-float rgb pixel
+struct rgb16f {
+    uint16_t r = 0, g = 0, b = 0;
+};
+
+// convert a half float to a float
+inline float half_to_float(uint16_t h) {
+    auto sign = (uint32_t)(h & 0x8000) << 16, e = (uint32_t)(h >> 10) & 0x1f, m = (uint32_t)h & 0x3ff;
+    auto bits = uint32_t(0);
+    if(e == 0x1f) bits = sign | 0x7f800000 | (m << 13);
+    else if(e) bits = sign | ((e + 112) << 23) | (m << 13);
+    else { auto f = m * (1.0f / 16777216); memcpy(&bits, &f, 4); bits |= sign; }
+    auto f = 0.0f; memcpy(&f, &bits, 4);
+    return f;
+}
+
+// convert a float to the nearest half float (rounding to even, out of range values become infinite)
+inline uint16_t float_to_half(float f) {
+    auto bits = uint32_t(0); memcpy(&bits, &f, 4);
+    auto sign = (uint16_t)((bits >> 16) & 0x8000);
+    bits &= 0x7fffffff;
+    if(bits > 0x7f800000) return sign | 0x7e00;
+    if(bits >= 0x477ff000) return sign | 0x7c00;
+    if(bits < 0x33000000) return sign;
+    if(bits < 0x38800000) {
+        // subnormal half
+        auto shift = 126 - (bits >> 23), m = (bits & 0x7fffff) | 0x800000;
+        return sign | (uint16_t)((m + (1u << (shift-1)) - 1 + ((m >> shift) & 1)) >> shift);
+    }
+    bits -= 112 << 23;
+    return sign | (uint16_t)((bits + 0xfff + ((bits >> 13) & 1)) >> 13);
+}
+
+// pixel conversions to and from float colors
+inline vec3f pixel_to_vec3f(const vec3f& p) { return p; }
+inline vec3f pixel_to_vec3f(const rgba8& p) { return vec3f(p.r,p.g,p.b) / 255.0f; }
+inline vec3f pixel_to_vec3f(const rgb16f& p) { return vec3f(half_to_float(p.r),half_to_float(p.g),half_to_float(p.b)); }
+inline void pixel_from_vec3f(vec3f& p, const vec3f& c) { p = c; }
+inline void pixel_from_vec3f(rgba8& p, const vec3f& c) {
+    p.r = (unsigned char)(clamp(c.x,0.0f,1.0f)*255+0.5f);
+    p.g = (unsigned char)(clamp(c.y,0.0f,1.0f)*255+0.5f);
+    p.b = (unsigned char)(clamp(c.z,0.0f,1.0f)*255+0.5f);
+    p.a = 255;
+}
+inline void pixel_from_vec3f(rgb16f& p, const vec3f& c) { p.r = float_to_half(c.x); p.g = float_to_half(c.y); p.b = float_to_half(c.z); }
+
+// A generic image with pixels stored as P (vec3f, rgb16f or rgba8)
+template<typename P>
+struct image {
     // Default Constructor (empty image)
-    image3f() : _w(0), _h(0) { }
+    image() : _w(0), _h(0) { }
     // Size Constructor (sets width and height)
-    image3f(int w, int h) : _w(w), _h(h), _d(_w*_h,vec3f()) { }
+    image(int w, int h) : _w(w), _h(h), _d(_w*_h,P()) { }
     // Size Constructor with initialization (sets width and height and initialize pixels)
-    image3f(int w, int h, const vec3f& v) : _w(w), _h(h), _d(_w*_h,vec3f()) {
-        for(auto &p : _d) p = v;
-    }
+    image(int w, int h, const P& v) : _w(w), _h(h), _d(_w*_h,v) { }
     
     // image width
     int width() const { return _w; }
@@ -21,61 +77,278 @@ struct image3f {
     int height() const { return _h; }
     
     // element access
-    vec3f& at(int i, int j) { return _d[j*_w+i]; }
+    P& at(int i, int j) { return _d[j*_w+i]; }
     // element access
-    const vec3f& at(int i, int j) const { return _d[j*_w+i]; }
+    const P& at(int i, int j) const { return _d[j*_w+i]; }
+    
+    // color access, converted from the storage format
+    vec3f get(int i, int j) const { return pixel_to_vec3f(at(i,j)); }
+    // color access, converted to the storage format
+    void set(int i, int j, const vec3f& c) { pixel_from_vec3f(at(i,j),c); }
     
     // data access
-    vec3f* data() { return _d.data(); }
+    P* data() { return _d.data(); }
     // data access
-    const vec3f* data() const { return _d.data(); }
+    const P* data() const { return _d.data(); }
+    // size of the pixel data in bytes
+    size_t size_bytes() const { return _d.size()*sizeof(P); }
     
     // flips this image along the y axis returning a new image
-    image3f flipy() const {
-        image3f ret(width(),height());
-        for(int j = 0; j < height(); j ++) {
-            for(int i = 0; i < width(); i ++) {
-                ret.at(i,height()-1-j) = at(i,j);
-            }
-        }
-        return ret;
-    }
+    image flipy() const { auto ret = *this; ret.flipy_inplace(); return ret; }
+    // apply gamma correction returning a new image
+    image gamma(float gamma) const { auto ret = *this; ret.gamma_inplace(gamma); return ret; }
+    // apply a scale to the image returning a new image
+    image scale(float s) const { auto ret = *this; ret.scale_inplace(s); return ret; }
     
-    // apply gamma correction
-    image3f gamma(float gamma) const {
-        image3f ret(width(),height());
-        for(int j = 0; j < height(); j ++) {
-            for(int i = 0; i < width(); i ++) {
-                ret.at(i,j) = pow(at(i,j),gamma);
-            }
+    // flips this image along the y axis in place, swapping rows
+    void flipy_inplace() {
+        auto row = vector<P>(_w);
+        auto size = sizeof(P)*_w;
+        for(auto j : range(_h/2)) {
+            auto a = data() + j*_w, b = data() + (_h-1-j)*_w;
+            memcpy(row.data(), a, size);
+            memcpy(a, b, size);
+            memcpy(b, row.data(), size);
         }
-        return ret;
-    }
-    
-    // apply a scale to the image
-    image3f scale(float s) {
-        image3f ret(width(),height());
-        for(int j = 0; j < height(); j ++) {
-            for(int i = 0; i < width(); i ++) {
-                ret.at(i,j) = at(i,j)*s;
-            }
-        }
-        return ret;
     }
+    // apply gamma correction in place, in bands of rows on all threads (float images only)
+    // (pow is approximated to a relative error below 3e-6)
+    void gamma_inplace(float gamma);
+    // apply a scale to the image in place, in bands of rows on all threads (float images only)
+    void scale_inplace(float s);
     
 private:
     int _w, _h;
-    vector<vec3f> _d;
+    vector<P> _d;
 };
 
+typedef image<vec3f>  image3f;  // float rgb image
+typedef image<rgb16f> image3h;  // half-float rgb image
+typedef image<rgba8>  image4b;  // 8-bit rgba image
+
+template<> void image3f::gamma_inplace(float gamma);
+template<> void image3f::scale_inplace(float s);
+
+// convert an image to another storage format, in bands of rows on all threads
+template<typename P, typename Q>
+inline image<P> convert_image(const image<Q>& img) {
+    auto ret = image<P>(img.width(),img.height());
+    auto src = img.data();
+    auto dst = ret.data();
+    parallel_for(img.height(), [src,dst,&img](int start, int end){
+        for(auto i : range(start*img.width(),end*img.width())) pixel_from_vec3f(dst[i],pixel_to_vec3f(src[i]));
+    }, 64);
+    return ret;
+}
+
 // Write an floating point color PFM image file
 void write_pfm(const string& filename, const image3f& img, bool flipY = false);
 // Write an 8-bit color compressed PNG file (sets PNG alpha to 1 everywhere)
-void write_png(const string& filename, const image3f& img, bool flipY = false);
+void write_png(const string& filename, const image3f& img, bool flipY = false, bool fast = false);
+
+// Asynchronous image writer: images are queued and encoded on background threads, so that
+// saving a frame overlaps with computing the next ones. The queue holds at most max_queued
+// images (write blocks while it is full) to bound memory when encoding is the bottleneck.
+// To use:
+//     ImageWriter writer;
+//     for(...) { ...; writer.write_png(filename, std::move(image), true, true); }
+//     writer.wait();
+struct ImageWriter {
+    // start the writer threads (0 for one less than the hardware threads)
+    ImageWriter(int nthreads = 0, int max_queued = 4);
+    // write the queued images and stop the threads
+    ~ImageWriter();
+    
+    // queue an image to be written as with write_png
+    void write_png(const string& filename, image3f&& img, bool flipY = false, bool fast = true);
+    // wait until all queued images are written
+    void wait();
+    
+    // queued image
+    struct _Job {
+        string      filename;   // filename
+        image3f     img;        // image
+        bool        flipY;      // whether to flip the image
+        bool        fast;       // whether to use the fast png settings
+    };
+    
+    int                         _max_queued = 4;    // maximum number of queued images
+    std::deque<_Job>            _queue;             // images to write
+    int                         _busy = 0;          // images being written
+    bool                        _stop = false;      // whether the threads should exit
+    std::mutex                  _mutex;             // guards queue, busy and stop
+    std::condition_variable     _wakeup;            // signals a new image or stop
+    std::condition_variable     _done;              // signals that an image was written
+    vector<std::thread>         _threads;           // writer threads
+    
+    // thread loop
+    void _run();
+};
+
+// Video stream writer: frames are appended to a single file, or to the standard output for "-",
+// either as YUV4MPEG2 (bt.601 4:2:0, e.g. to pipe into "ffmpeg -i - video.mp4") or as raw 8-bit
+// rgb. While streaming to the standard output, messages are redirected to the standard error.
+struct VideoWriter {
+    // open the stream (fps is only recorded in the YUV4MPEG2 header)
+    VideoWriter(const string& filename, int width, int height, float fps, bool y4m = true);
+    // close the stream
+    ~VideoWriter();
+    
+    // append a frame of the stream size
+    void write_frame(const image3f& img, bool flipY = false);
+    
+    FILE*                   _file = nullptr;    // output stream
+    bool                    _y4m = true;        // whether frames are YUV4MPEG2 or raw rgb
+    int                     _width = 0;         // frame width
+    int                     _height = 0;        // frame height
+    vector<unsigned char>   _frame;             // bytes of the last frame
+};
 
 // Load a PFM or PPM color image and return it as a floating point color image
 image3f read_pnm(const string& filename, bool flipY);
 // Load a compressed PNG color image and return it as a floating point color image
 image3f read_png(const string& filename, bool flipY);
+// Load a compressed PNG color image and return it as an 8-bit rgba image
+image4b read_png4b(const string& filename, bool flipY);
+
+// Mip chain of an image: the image and its box-filtered halvings down to 1x1, each level stored in
+// tiles of 8x8 pixels (tiles by rows, pixels in Morton order within a tile), so that filtered
+// lookups touch few cache lines; levels follow the GL sizes, so that they can be uploaded as is
+template<typename P>
+struct mipchain {
+    // level layout
+    struct level {
+        int     width;      // level width
+        int     height;     // level height
+        int     tiles_x;    // number of tiles in a row
+        int     offset;     // index of the first pixel in data
+    };
+    
+    vector<level>   levels;     // levels, from the full image to 1x1
+    vector<P>       data;       // pixels of all levels
+    
+    // build the chain from an image, in bands of rows on all threads
+    void build(const image<P>& img) {
+        levels.clear();
+        auto w = img.width(), h = img.height(), offset = 0;
+        while(true) {
+            auto tiles_x = (w+7)/8, tiles_y = (h+7)/8;
+            levels.push_back({w,h,tiles_x,offset});
+            offset += tiles_x*tiles_y*64;
+            if(w == 1 and h == 1) break;
+            w = max(1,w/2); h = max(1,h/2);
+        }
+        data.assign(offset, P());
+        auto self = this;
+        parallel_for(img.height(), [self,&img](int start, int end){
+            for(auto j : range(start,end)) for(auto i : range(img.width())) self->texel(0,i,j) = img.at(i,j);
+        }, 64);
+        for(auto l : range(1,(int)levels.size())) {
+            auto& lv = levels[l]; auto& up = levels[l-1];
+            parallel_for(lv.height, [self,l,&lv,&up](int start, int end){
+                for(auto j : range(start,end)) {
+                    auto j0 = 2*j, j1 = min(2*j+1,up.height-1);
+                    for(auto i : range(lv.width)) {
+                        auto i0 = 2*i, i1 = min(2*i+1,up.width-1);
+                        auto c = self->get(l-1,i0,j0) + self->get(l-1,i1,j0) + self->get(l-1,i0,j1) + self->get(l-1,i1,j1);
+                        pixel_from_vec3f(self->texel(l,i,j), c * 0.25f);
+                    }
+                }
+            }, 64);
+        }
+    }
+    
+    // index of a pixel in data
+    int index(int l, int i, int j) const {
+        auto& lv = levels[l];
+        auto x = i & 7, y = j & 7;
+        auto morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3);
+        return lv.offset + ((j >> 3)*lv.tiles_x + (i >> 3))*64 + morton;
+    }
+    // pixel access
+    P& texel(int l, int i, int j) { return data[index(l,i,j)]; }
+    // pixel access
+    const P& texel(int l, int i, int j) const { return data[index(l,i,j)]; }
+    // color access, converted from the storage format
+    vec3f get(int l, int i, int j) const { return pixel_to_vec3f(texel(l,i,j)); }
+    
+    // bilinear lookup in a level, with repeating texture coordinates (as GL_REPEAT)
+    vec3f bilinear(int l, const vec2f& uv) const {
+        auto& lv = levels[l];
+        auto x = uv.x*lv.width - 0.5f, y = uv.y*lv.height - 0.5f;
+        auto fx = floor(x), fy = floor(y);
+        auto u = x - fx, v = y - fy;
+        auto i0 = (int)fx % lv.width, j0 = (int)fy % lv.height;
+        if(i0 < 0) i0 += lv.width;
+        if(j0 < 0) j0 += lv.height;
+        auto i1 = (i0+1 == lv.width) ? 0 : i0+1, j1 = (j0+1 == lv.height) ? 0 : j0+1;
+        return (get(l,i0,j0)*(1-u) + get(l,i1,j0)*u)*(1-v) + (get(l,i0,j1)*(1-u) + get(l,i1,j1)*u)*v;
+    }
+    // trilinear lookup at a level of detail (0 for the full image, fractional between levels)
+    vec3f sample(const vec2f& uv, float lod) const {
+        lod = clamp(lod, 0.0f, (float)levels.size()-1);
+        auto l = (int)lod;
+        auto t = lod - l;
+        auto c = bilinear(l,uv);
+        return (t > 0) ? c*(1-t) + bilinear(l+1,uv)*t : c;
+    }
+    
+    // level pixels in row-major order (e.g. for uploads)
+    image<P> level_image(int l) const {
+        auto& lv = levels[l];
+        auto img = image<P>(lv.width,lv.height);
+        for(auto j : range(lv.height)) for(auto i : range(lv.width)) img.at(i,j) = texel(l,i,j);
+        return img;
+    }
+};
+
+// storage formats of a texture
+enum TextureFormat { texture_rgba8 = 0, texture_rgb16f = 1, texture_rgb32f = 2 };
+
+// texture kept as a mip chain in the most compact format for its content: 8-bit rgba for png
+// files and floats for pfm files (or half floats, see set_texture_half_float); colors are converted
+// on access. Mip chains are built when textures are decoded and stored in the asset cache.
+struct Texture {
+    TextureFormat       format = texture_rgb32f;    // storage format (selects the mip chain in use)
+    mipchain<rgba8>     mips4b;                     // 8-bit mip chain (texture_rgba8)
+    mipchain<rgb16f>    mips3h;                     // half-float mip chain (texture_rgb16f)
+    mipchain<vec3f>     mips3f;                     // float mip chain (texture_rgb32f)
+    
+    // texture size
+    int width() const { return level_width(0); }
+    int height() const { return level_height(0); }
+    // number of mip levels and their sizes
+    int levels() const { return (format == texture_rgba8) ? mips4b.levels.size() : (format == texture_rgb16f) ? mips3h.levels.size() : mips3f.levels.size(); }
+    int level_width(int l) const { return (format == texture_rgba8) ? mips4b.levels[l].width : (format == texture_rgb16f) ? mips3h.levels[l].width : mips3f.levels[l].width; }
+    int level_height(int l) const { return (format == texture_rgba8) ? mips4b.levels[l].height : (format == texture_rgb16f) ? mips3h.levels[l].height : mips3f.levels[l].height; }
+    
+    // color access in the full image, converted from the storage format
+    vec3f get(int i, int j) const { return (format == texture_rgba8) ? mips4b.get(0,i,j) : (format == texture_rgb16f) ? mips3h.get(0,i,j) : mips3f.get(0,i,j); }
+    // filtered color lookup (see mipchain::sample)
+    vec3f sample(const vec2f& uv, float lod) const { return (format == texture_rgba8) ? mips4b.sample(uv,lod) : (format == texture_rgb16f) ? mips3h.sample(uv,lod) : mips3f.sample(uv,lod); }
+    
+    // pixels of a level in row-major order and in the storage format (e.g. for uploads)
+    vector<unsigned char> level_data(int l) const;
+    // size of the pixel data in bytes
+    size_t size_bytes() const { return (format == texture_rgba8) ? mips4b.data.size()*sizeof(rgba8) : (format == texture_rgb16f) ? mips3h.data.size()*sizeof(rgb16f) : mips3f.data.size()*sizeof(vec3f); }
+};
+
+// Process-wide texture cache: each image is decoded once per canonical path and shared
+// between scene loads. Concurrent requests for different images decode in parallel,
+// while requests for an image being decoded wait for it. Each acquire should be matched by
+// a release; the image is freed when the last reference is released.
+Texture* acquire_texture(const string& filename);
+void release_texture(Texture* txt);
+
+// store pfm textures decoded from now on as half floats instead of floats
+void set_texture_half_float(bool half_float);
+
+// file a cached texture was decoded from (empty if not in the cache)
+string texture_filename(Texture* txt);
+// decode a cached texture again from its file, in place, so that all its users see the new data
+void reload_texture(Texture* txt);
+// whether a file can be decoded as a texture, without stopping on errors (png files are decoded,
+// pfm headers and sizes are checked); otherwise msg describes the problem
+bool check_texture_file(const string& filename, string& msg);
 
 #endif
@@ -1,41 +1,348 @@
 #include "json.h"
-#include "picojson.h"
-
-// json value conversion from parser
-static jsonvalue _to_jsonvalue(const picojson::value& pjson) {
-    if(pjson.is<picojson::null>()) return jsonvalue();
-    else if(pjson.is<bool>()) return jsonvalue( pjson.get<bool>() );
-    else if(pjson.is<double>()) return jsonvalue( pjson.get<double>() );
-    else if(pjson.is<string>()) return jsonvalue( pjson.get<string>() );
-    else if(pjson.is<picojson::array>()) {
-        auto json = jsonvalue::array();
-        for(auto& j : pjson.get<picojson::array>()) json.push_back(_to_jsonvalue(j));
-        return jsonvalue(json);
-    }
-    else if(pjson.is<picojson::object>()) {
-        auto json = jsonvalue::object();
-        for(auto& nj : pjson.get<picojson::object>()) json[nj.first] = _to_jsonvalue(nj.second);
-        return jsonvalue(json);
-    } else { error("unknown type"); return jsonvalue(); }
+#include <cstdlib>
+#include <cmath>
+#include <cctype>
+#include <cstring>
+
+JsonReader::JsonReader(const string& filename) : _filename(filename), _buffer(load_binary_file(filename)), _first(true) {
+    _c = _buffer.c_str();
+}
+
+void JsonReader::_expect_literal(const char* lit) {
+    _peek();
+    for(auto l = lit; *l; l++, _c++) {
+        error_if_not(*_c == *l, "json reading error in %s: expected %s at %d\n", _filename.c_str(), lit, (int)(_c-_buffer.c_str()));
+    }
+}
+
+bool JsonReader::next_key(string& key) {
+    if(_peek() == '}') { _c++; _first = false; return false; }
+    if(not _first) _expect(',');
+    _first = false;
+    key = read_string();
+    _expect(':');
+    return true;
+}
+
+bool JsonReader::next_element() {
+    if(_peek() == ']') { _c++; _first = false; return false; }
+    if(not _first) _expect(',');
+    _first = false;
+    return true;
+}
+
+bool JsonReader::read_bool() {
+    if(_peek() == 't') { _expect_literal("true"); return true; }
+    _expect_literal("false");
+    return false;
+}
+
+double JsonReader::read_number() {
+    _peek();
+    char* end = nullptr;
+    auto value = strtod(_c, &end);
+    error_if_not(end != _c, "json reading error in %s: expected number at %d\n", _filename.c_str(), (int)(_c-_buffer.c_str()));
+    _c = end;
+    return value;
+}
+
+// value of the 4 hex digits of a unicode escape, or -1 if they are not all hex digits
+// (the buffer is null terminated, so a truncated escape stops at a non-hex character)
+static int _json_hex4(const char* c) {
+    auto value = 0;
+    for(auto i : range(4)) {
+        if(not isxdigit((unsigned char)c[i])) return -1;
+        value = value * 16 + ((c[i] <= '9') ? c[i]-'0' : (c[i]|0x20)-'a'+10);
+    }
+    return value;
+}
+
+string JsonReader::read_string() {
+    _expect('"');
+    auto str = string();
+    while(*_c != '"') {
+        error_if_not(*_c, "json reading error in %s: unterminated string\n", _filename.c_str());
+        if(*_c != '\\') { str += *_c++; continue; }
+        _c++;
+        switch(*_c++) {
+            case '"': str += '"'; break;
+            case '\\': str += '\\'; break;
+            case '/': str += '/'; break;
+            case 'b': str += '\b'; break;
+            case 'f': str += '\f'; break;
+            case 'n': str += '\n'; break;
+            case 'r': str += '\r'; break;
+            case 't': str += '\t'; break;
+            case 'u': {
+                // encode the code point as utf-8, combining utf-16 surrogate pairs (unpaired surrogates are errors)
+                auto cp = _json_hex4(_c);
+                error_if_not(cp >= 0, "json reading error in %s: bad unicode escape at %d\n", _filename.c_str(), (int)(_c-_buffer.c_str()));
+                _c += 4;
+                if(cp >= 0xd800 and cp < 0xdc00) {
+                    auto low = (_c[0] == '\\' and _c[1] == 'u') ? _json_hex4(_c+2) : -1;
+                    error_if_not(low >= 0xdc00 and low < 0xe000, "json reading error in %s: unpaired surrogate at %d\n", _filename.c_str(), (int)(_c-_buffer.c_str()));
+                    cp = 0x10000 + ((cp-0xd800) << 10) + (low-0xdc00);
+                    _c += 6;
+                }
+                error_if_not(cp < 0xdc00 or cp >= 0xe000, "json reading error in %s: unpaired surrogate at %d\n", _filename.c_str(), (int)(_c-_buffer.c_str()));
+                if(cp < 0x80) str += (char)cp;
+                else if(cp < 0x800) { str += (char)(0xc0|(cp>>6)); str += (char)(0x80|(cp&0x3f)); }
+                else if(cp < 0x10000) { str += (char)(0xe0|(cp>>12)); str += (char)(0x80|((cp>>6)&0x3f)); str += (char)(0x80|(cp&0x3f)); }
+                else { str += (char)(0xf0|(cp>>18)); str += (char)(0x80|((cp>>12)&0x3f)); str += (char)(0x80|((cp>>6)&0x3f)); str += (char)(0x80|(cp&0x3f)); }
+            } break;
+            default: error("json reading error in %s: bad escape\n", _filename.c_str());
+        }
+    }
+    _c++;
+    return str;
+}
+
+jsonvalue JsonReader::read_value() {
+    switch(_peek()) {
+        case 'n': _expect_literal("null"); return jsonvalue();
+        case 't': case 'f': return jsonvalue(read_bool());
+        case '"': return jsonvalue(read_string());
+        case '[': {
+            // numbers are read in a numeric array until another value type is found
+            auto numbers = jsonvalue::numarray();
+            auto json = jsonvalue::array();
+            begin_array();
+            while(next_element()) {
+                auto c = _peek();
+                if(json.empty() and (c == '-' or (c >= '0' and c <= '9'))) { numbers.push_back(read_number()); continue; }
+                if(json.empty()) for(auto n : numbers) json.push_back(jsonvalue(n));
+                json.push_back(read_value());
+            }
+            if(json.empty() and not numbers.empty()) return jsonvalue(std::move(numbers));
+            return jsonvalue(std::move(json));
+        }
+        case '{': {
+            auto json = jsonvalue::object();
+            auto key = string();
+            begin_object();
+            while(next_key(key)) json[key] = read_value();
+            return jsonvalue(std::move(json));
+        }
+        default: return jsonvalue(read_number());
+    }
+}
+
+void JsonReader::skip_value() {
+    switch(_peek()) {
+        case 'n': _expect_literal("null"); break;
+        case 't': case 'f': read_bool(); break;
+        case '"': read_string(); break;
+        case '[': { begin_array(); while(next_element()) skip_value(); } break;
+        case '{': { auto key = string(); begin_object(); while(next_key(key)) skip_value(); } break;
+        default: read_number(); break;
+    }
+}
+
+// json syntax checking: walks the text as JsonReader does, but reports the first error instead of stopping
+static bool _check_json_error(const char* c, const char* start, const char* what, string& msg) {
+    msg = tostring("%s at %d", what, (int)(c-start));
+    return false;
+}
+
+static void _check_json_space(const char*& c) { while(*c == ' ' or *c == '\n' or *c == '\r' or *c == '\t') c++; }
+
+static bool _check_json_string(const char*& c, const char* start, string& msg) {
+    c++;
+    while(*c != '"') {
+        if(not *c) return _check_json_error(c, start, "unterminated string", msg);
+        if(*c++ != '\\') continue;
+        if(*c == 'u') {
+            c++;
+            auto cp = _json_hex4(c);
+            if(cp < 0) return _check_json_error(c, start, "bad unicode escape", msg);
+            c += 4;
+            if(cp >= 0xdc00 and cp < 0xe000) return _check_json_error(c, start, "unpaired surrogate", msg);
+            if(cp >= 0xd800 and cp < 0xdc00) {
+                auto low = (c[0] == '\\' and c[1] == 'u') ? _json_hex4(c+2) : -1;
+                if(low < 0xdc00 or low >= 0xe000) return _check_json_error(c, start, "unpaired surrogate", msg);
+                c += 6;
+            }
+        } else if(*c and strchr("\"\\/bfnrt", *c)) c++;
+        else return _check_json_error(c, start, "bad escape", msg);
+    }
+    c++;
+    return true;
+}
+
+static bool _check_json_value(const char*& c, const char* start, string& msg) {
+    _check_json_space(c);
+    switch(*c) {
+        case 'n': case 't': case 'f': {
+            auto lit = (*c == 'n') ? "null" : (*c == 't') ? "true" : "false";
+            if(strncmp(c, lit, strlen(lit)) != 0) return _check_json_error(c, start, tostring("expected %s", lit).c_str(), msg);
+            c += strlen(lit);
+            return true;
+        }
+        case '"': return _check_json_string(c, start, msg);
+        case '[': case '{': {
+            auto object = *c == '{';
+            c++;
+            for(auto first = true; ; first = false) {
+                _check_json_space(c);
+                if(*c == ((object) ? '}' : ']')) { c++; return true; }
+                if(not first) {
+                    if(*c != ',') return _check_json_error(c, start, "expected ','", msg);
+                    c++;
+                    _check_json_space(c);
+                }
+                if(object) {
+                    if(*c != '"') return _check_json_error(c, start, "expected '\"'", msg);
+                    if(not _check_json_string(c, start, msg)) return false;
+                    _check_json_space(c);
+                    if(*c != ':') return _check_json_error(c, start, "expected ':'", msg);
+                    c++;
+                }
+                if(not _check_json_value(c, start, msg)) return false;
+            }
+        }
+        default: {
+            char* end = nullptr;
+            strtod(c, &end);
+            if(end == c) return _check_json_error(c, start, "expected number", msg);
+            c = end;
+            return true;
+        }
+    }
+}
+
+bool check_json(const string& text, string& msg) {
+    auto start = text.c_str();
+    auto c = start;
+    if(not _check_json_value(c, start, msg)) return false;
+    _check_json_space(c);
+    if(*c) return _check_json_error(c, start, "trailing characters", msg);
+    return true;
 }
 
 // json handling
+bool operator==(const jsonvalue& a, const jsonvalue& b) {
+    auto a_array = a.is_array() or a.is_numarray(), b_array = b.is_array() or b.is_numarray();
+    if(a_array and b_array and (a.is_numarray() or b.is_numarray())) {
+        if(a.array_size() != b.array_size()) return false;
+        if(a.is_numarray() and b.is_numarray()) return a.as_numarray_ref() == b.as_numarray_ref();
+        auto& numbers = (a.is_numarray()) ? a : b;
+        auto& values = (a.is_numarray()) ? b : a;
+        for(auto i : range(values.array_size())) {
+            auto& value = values.array_element(i);
+            if(not value.is_number() or value.as_double() != numbers.array_number(i)) return false;
+        }
+        return true;
+    }
+    if(a._type != b._type) return false;
+    switch(a._type) {
+        case jsonvalue::nullt: return true;
+        case jsonvalue::boolt: return a._b == b._b;
+        case jsonvalue::doublet: return a._d == b._d;
+        case jsonvalue::stringt: return *a._s == *b._s;
+        case jsonvalue::arrayt: return *a._a == *b._a;
+        case jsonvalue::objectt: {
+            if(a._o->size() != b._o->size()) return false;
+            for(auto ai = a._o->begin(), bi = b._o->begin(); ai != a._o->end(); ++ai, ++bi) {
+                if(ai->first != bi->first or ai->second != bi->second) return false;
+            }
+            return true;
+        }
+        default: error("wrong type"); return false;
+    }
+}
+
 jsonvalue load_json(const string& filename) {
-    // open file
-    std::ifstream stream(filename.c_str(), std::ifstream::in);
-    error_if_not(stream.good(), "cannot open file: %s\n", filename.c_str());
-    // read json
-    picojson::value pjson;
-    stream >> pjson;
-    auto err = picojson::get_last_error();
-    error_if_not(err.empty(), "json reading error: %s\n", err.c_str());
-    stream.close();
-    // conversion
-    auto json = _to_jsonvalue(pjson);
-    // done
+    auto reader = JsonReader(filename);
+    auto json = reader.read_value();
+    error_if_not(reader._peek() == 0, "json reading error in %s: trailing characters\n", filename.c_str());
     return json;
 }
 
+bool load_json(const string& filename, jsonvalue& json, string& msg) {
+    auto f = fopen(filename.c_str(), "rb");
+    if(not f) { msg = tostring("cannot open file: %s", filename.c_str()); return false; }
+    fclose(f);
+    auto text = load_binary_file(filename);
+    if(not check_json(text, msg)) { msg = tostring("json reading error in %s: %s", filename.c_str(), msg.c_str()); return false; }
+    json = parse_json(text);
+    return true;
+}
+
+jsonvalue parse_json(const string& text) {
+    auto reader = JsonReader("json text", text);
+    auto json = reader.read_value();
+    error_if_not(reader._peek() == 0, "json reading error: trailing characters\n");
+    return json;
+}
+
+// append a json string with escapes
+static void _format_json_string(string& out, const string& str) {
+    out += '"';
+    for(auto c : str) {
+        switch(c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: out += c;
+        }
+    }
+    out += '"';
+}
+
+// append a json value
+static void _format_json(string& out, const jsonvalue& json) {
+    switch(json._type) {
+        case jsonvalue::nullt: out += "null"; break;
+        case jsonvalue::boolt: out += (json._b) ? "true" : "false"; break;
+        case jsonvalue::doublet: {
+            char buf[32];
+            if(json._d > -1e9 and json._d < 1e9 and json._d == (int)json._d and not std::signbit(json._d)) sprintf(buf, "%d", (int)json._d);
+            else sprintf(buf, "%.9g", json._d);
+            out += buf;
+        } break;
+        case jsonvalue::stringt: _format_json_string(out, *json._s); break;
+        case jsonvalue::arrayt: {
+            out += '[';
+            for(auto i : range(json._a->size())) { if(i) out += ','; _format_json(out, json._a->at(i)); }
+            out += ']';
+        } break;
+        case jsonvalue::numarrayt: {
+            out += '[';
+            for(auto i : range(json._n->size())) { if(i) out += ','; _format_json(out, jsonvalue(json._n->at(i))); }
+            out += ']';
+        } break;
+        case jsonvalue::objectt: {
+            out += '{';
+            auto first = true;
+            for(auto& kv : *json._o) {
+                if(not first) out += ',';
+                first = false;
+                _format_json_string(out, kv.first);
+                out += ':';
+                _format_json(out, kv.second);
+            }
+            out += '}';
+        } break;
+        default: error("wrong type");
+    }
+}
+
+string format_json(const jsonvalue& json) {
+    auto out = string();
+    _format_json(out, json);
+    return out;
+}
+
+void save_json(const string& filename, const jsonvalue& json) {
+    auto f = fopen(filename.c_str(), "wb");
+    error_if_not(f, "cannot open file: %s\n", filename.c_str());
+    auto text = format_json(json);
+    error_if_not(fwrite(text.data(), 1, text.size(), f) == text.size(), "cannot write file: %s\n", filename.c_str());
+    fclose(f);
+}
+
 // print usage information
 static void _cmdline_print_usage(const CommandLine& cmd) {
     auto usage = "usage: " + cmd.progname;
@@ -131,7 +438,7 @@ jsonvalue parse_cmdline(const vector<string>& args, const CommandLine& cmd) {
         }
     }
     if(not largs.empty()) _cmdline_parse_error("too many arguments",cmd);
-    return jsonvalue(parsed);
+    return jsonvalue(std::move(parsed));
 }
 
 // parsing values
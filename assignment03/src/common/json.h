@@ -3,23 +3,67 @@
 
 #include "common.h"
 
+#include <type_traits>
+
+// flat map with keys kept sorted in a vector; scene objects are small, so lookups
+// by binary search and a single allocation beat the nodes of a std::map
+template<typename V>
+struct flat_map {
+    typedef pair<string,V> value_type;
+    typedef typename vector<value_type>::iterator iterator;
+    typedef typename vector<value_type>::const_iterator const_iterator;
+    
+    vector<value_type> _items;  // items sorted by key
+    
+    // iteration in key order
+    iterator begin() { return _items.begin(); }
+    iterator end() { return _items.end(); }
+    const_iterator begin() const { return _items.begin(); }
+    const_iterator end() const { return _items.end(); }
+    int size() const { return _items.size(); }
+    bool empty() const { return _items.empty(); }
+    
+    // lookup
+    iterator find(const string& key) { auto it = _lower_bound(key); return (it != end() and it->first == key) ? it : end(); }
+    const_iterator find(const string& key) const { return const_cast<flat_map*>(this)->find(key); }
+    int count(const string& key) const { return find(key) != end(); }
+    
+    // access, inserting a default value if missing
+    V& operator[](const string& key) {
+        auto it = _lower_bound(key);
+        if(it == end() or it->first != key) it = _items.insert(it, value_type(key, V()));
+        return it->second;
+    }
+    
+    // removal
+    void erase(const string& key) { auto it = find(key); if(it != end()) _items.erase(it); }
+    
+    // first item whose key is not less than key
+    iterator _lower_bound(const string& key) {
+        return std::lower_bound(_items.begin(), _items.end(), key, [](const value_type& item, const string& key) { return item.first < key; });
+    }
+};
+
 // simple generic value for serialization and command line options
 // modeled on the JSON model, but with builtin semantics for fast
 // different number formats and arrays of basic types
+// arrays made only of numbers are stored as a typed numeric array, one allocation for the whole array
 struct jsonvalue {
     // typedefs
     typedef vector<jsonvalue> array;
-    typedef map<string,jsonvalue> object;
+    typedef flat_map<jsonvalue> object;
+    typedef vector<double> numarray;
     
     // possible types of jsonvalue
-    enum _Type { nullt, boolt, doublet, stringt, arrayt, objectt };
+    enum _Type { nullt, boolt, doublet, stringt, arrayt, objectt, numarrayt };
     _Type _type = nullt;    // current type
     union {
-        bool    _b; // bool value
-        double  _d; // number value
-        string* _s; // string value
-        array*  _a; // generic array value
-        object* _o; // object type
+        bool      _b; // bool value
+        double    _d; // number value
+        string*   _s; // string value
+        array*    _a; // generic array value
+        object*   _o; // object type
+        numarray* _n; // numeric array value
     };
     
     // constructor
@@ -31,27 +75,40 @@ struct jsonvalue {
     explicit jsonvalue(double d) : _type(doublet), _d(d) { }
     explicit jsonvalue(const string& s) : _type(stringt), _s(new string(s)) { }
     explicit jsonvalue(const char* s) : _type(stringt), _s(new string(s)) { }
-    explicit jsonvalue(const array& a) : _type(arrayt), _a(new vector<jsonvalue>(a)) { }
-    explicit jsonvalue(const object& o) : _type(objectt), _o(new map<string,jsonvalue>(o)) { }
+    explicit jsonvalue(const array& a) : _type(arrayt), _a(new array(a)) { }
+    explicit jsonvalue(const object& o) : _type(objectt), _o(new object(o)) { }
+    explicit jsonvalue(const numarray& n) : _type(numarrayt), _n(new numarray(n)) { }
+    
+    // value constructors that take ownership of their argument
+    explicit jsonvalue(string&& s) : _type(stringt), _s(new string(std::move(s))) { }
+    explicit jsonvalue(array&& a) : _type(arrayt), _a(new array(std::move(a))) { }
+    explicit jsonvalue(object&& o) : _type(objectt), _o(new object(std::move(o))) { }
+    explicit jsonvalue(numarray&& n) : _type(numarrayt), _n(new numarray(std::move(n))) { }
     
     // copy constructor
     jsonvalue(const jsonvalue& j) : _type(nullt) { set(j); }
+    // move constructor (noexcept, so that vectors of values move them when growing)
+    jsonvalue(jsonvalue&& j) noexcept : _type(nullt) { _steal(j); }
     
     // destuctor
     ~jsonvalue() { _clear(); }
     
     // assignment
     jsonvalue& operator=(const jsonvalue& j) { set(j); return *this; }
+    // move assignment
+    jsonvalue& operator=(jsonvalue&& j) noexcept { if(this != &j) { _clear(); _steal(j); } return *this; }
     
     // clear
     void _clear() {
         if(_type==stringt) delete _s;
         if(_type==arrayt) delete _a;
         if(_type==objectt) delete _o;
+        if(_type==numarrayt) delete _n;
         _type = nullt;
     }
     // set
     void set(const jsonvalue& j) {
+        if(this == &j) return;
         if(_type != nullt) _clear();
         _type = j._type;
         switch(_type) {
@@ -59,19 +116,37 @@ struct jsonvalue {
             case boolt: _b = j._b; break;
             case doublet: _d = j._d; break;
             case stringt: _s = new string(*j._s); break;
-            case arrayt: _a = new vector<jsonvalue>(*j._a); break;
-            case objectt: _o = new map<string,jsonvalue>(*j._o); break;
+            case arrayt: _a = new array(*j._a); break;
+            case objectt: _o = new object(*j._o); break;
+            case numarrayt: _n = new numarray(*j._n); break;
             default: error("wrong type");
         }
     }
+    // take the value of j, leaving it null (assumes this is null); never fails
+    void _steal(jsonvalue& j) noexcept {
+        _type = j._type;
+        switch(_type) {
+            case nullt: break;
+            case boolt: _b = j._b; break;
+            case doublet: _d = j._d; break;
+            case stringt: _s = j._s; break;
+            case arrayt: _a = j._a; break;
+            case objectt: _o = j._o; break;
+            case numarrayt: _n = j._n; break;
+            default: _type = nullt; break;
+        }
+        j._type = nullt;
+    }
     
-    // type checking
+    // type checking (arrays of values and numeric arrays are told apart, since only the former
+    // have elements accessible as jsonvalues; array_size works on both)
     bool is_null() const { return _type == nullt; }
     bool is_bool() const { return _type == boolt; }
     bool is_number() const { return _type == doublet; }
     bool is_string() const { return _type == stringt; }
     bool is_array() const { return _type == arrayt; }
     bool is_object() const { return _type == objectt; }
+    bool is_numarray() const { return _type == numarrayt; }
     
     // getters for values
     bool as_bool() const { error_if_not(is_bool(), "wrong type"); return _b; }
@@ -80,19 +155,107 @@ struct jsonvalue {
     double as_double() const { error_if_not(is_number(), "wrong type"); return _d; }
     string as_string() const { error_if_not(is_string(), "wrong type"); return *_s; }
     
-    // getters for arrays and objects
-    const vector<jsonvalue>& as_array_ref() const { error_if_not(is_array(), "wrong type"); return *_a; }
-    const map<string,jsonvalue>& as_object_ref() const { error_if_not(is_object(), "wrong type"); return *_o; }
+    // getters for arrays and objects (numeric arrays are only accessible as numarray)
+    const array& as_array_ref() const { error_if_not(_type == arrayt, "wrong type"); return *_a; }
+    const object& as_object_ref() const { error_if_not(is_object(), "wrong type"); return *_o; }
+    const numarray& as_numarray_ref() const { error_if_not(is_numarray(), "wrong type"); return *_n; }
 
     // proprties of arrays and objects
-    int array_size() const { return as_array_ref().size(); }
+    int array_size() const { return (is_numarray()) ? _n->size() : as_array_ref().size(); }
     const jsonvalue& array_element(int idx) const { error_if_not(idx >= 0 and idx < array_size(), "wrong element index"); return as_array_ref().at(idx); }
+    double array_number(int idx) const { error_if_not(idx >= 0 and idx < array_size(), "wrong element index"); return (is_numarray()) ? _n->at(idx) : as_array_ref().at(idx).as_double(); }
     bool object_contains(const string& name) const { return as_object_ref().find(name) != as_object_ref().end(); }
     const jsonvalue& object_element(const string& name) const { error_if_not(object_contains(name), "wrong element name"); return as_object_ref().find(name)->second; }
 };
 
+// values must move without copying when arrays and objects grow
+static_assert(std::is_nothrow_move_constructible<jsonvalue>::value, "jsonvalue must be nothrow movable");
+
+// deep comparison of json values (numeric arrays compare equal to arrays of the same numbers)
+bool operator==(const jsonvalue& a, const jsonvalue& b);
+inline bool operator!=(const jsonvalue& a, const jsonvalue& b) { return not (a == b); }
+
 // json loading
 jsonvalue load_json(const string& filename);
+// json loading that reports errors instead of stopping: returns whether the file could be read
+// and parsed, otherwise msg describes the problem
+bool load_json(const string& filename, jsonvalue& json, string& msg);
+// json parsing from text
+jsonvalue parse_json(const string& text);
+// whether text is well-formed json (as read by parse_json), without stopping on errors;
+// otherwise msg describes the first error
+bool check_json(const string& text, string& msg);
+// json formatting (compact, numbers are printed with float precision)
+string format_json(const jsonvalue& json);
+// json saving
+void save_json(const string& filename, const jsonvalue& json);
+
+// streaming (pull) json reader that walks a file one token at a time without building a
+// document, so that large numeric arrays are parsed directly into their destination
+// To use:
+//     auto reader = JsonReader(filename);
+//     reader.begin_object();
+//     auto key = string();
+//     while(reader.next_key(key)) { if(key == "pos") reader.read_array(pos); else reader.skip_value(); }
+struct JsonReader {
+    // open a file and read it in memory
+    JsonReader(const string& filename);
+    // read json text from memory (name is used for errors)
+    JsonReader(const string& name, const string& text) : _filename(name), _buffer(text), _c(_buffer.c_str()), _first(true) { }
+    
+    // true if the next value is of the given type
+    bool is_null() { return _peek() == 'n'; }
+    bool is_object() { return _peek() == '{'; }
+    bool is_array() { return _peek() == '['; }
+    
+    // start reading an object
+    void begin_object() { _expect('{'); _first = true; }
+    // read the next key of an object, returns false at the end of the object
+    bool next_key(string& key);
+    // start reading an array
+    void begin_array() { _expect('['); _first = true; }
+    // move to the next element of an array, returns false at the end of the array
+    bool next_element();
+    
+    // read basic values
+    bool read_bool();
+    double read_number();
+    string read_string();
+    // read any value into a jsonvalue
+    jsonvalue read_value();
+    // skip any value
+    void skip_value();
+    
+    // read an array of numbers into a vector of T, where T is made of N numbers of type E
+    // (e.g. read_array<float,3>() for vec3f); numbers are written directly in the vector memory
+    template<typename E, int N, typename T>
+    void read_array(vector<T>& value) {
+        static_assert(sizeof(T) == sizeof(E)*N, "wrong element size");
+        auto count = 0;
+        value.resize(0);
+        begin_array();
+        while(next_element()) {
+            if(count == (int)value.size()*N) value.resize(std::max(16,(int)value.size()*2));
+            ((E*)value.data())[count++] = (E)read_number();
+        }
+        error_if_not(count % N == 0, "incorrect array size in %s", _filename.c_str());
+        value.resize(count/N);
+    }
+    // read an array of bools
+    void read_array(vector<bool>& value) { value.clear(); begin_array(); while(next_element()) value.push_back(read_bool()); }
+    
+    string      _filename;  // filename (for errors)
+    string      _buffer;    // file contents
+    const char* _c;         // current position
+    bool        _first;     // whether we are at the first element of an object or array
+    
+    // skip whitespace and return the next character
+    char _peek() { while(*_c == ' ' or *_c == '\n' or *_c == '\r' or *_c == '\t') _c++; return *_c; }
+    // check for a character and move past it
+    void _expect(char c) { error_if_not(_peek() == c, "json reading error in %s: expected '%c' at %d\n", _filename.c_str(), c, (int)(_c-_buffer.c_str())); _c++; }
+    // check for a literal and move past it
+    void _expect_literal(const char* lit);
+};
 
 // command line specification
 struct CommandLine {
@@ -1,7 +1,22 @@
 #include "scene.h"
+#include "binary.h"
+#include "tesselation.h"
 
-vector<image3f*> get_textures(Scene* scene) {
-    auto textures = set<image3f*>();
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <sys/stat.h>
+#endif
+
+vector<Texture*> get_textures(Scene* scene) {
+    auto textures = set<Texture*>();
     for(auto mesh : scene->meshes) {
         if(mesh->mat->ke_txt) textures.insert(mesh->mat->ke_txt);
         if(mesh->mat->kd_txt) textures.insert(mesh->mat->kd_txt);
@@ -14,7 +29,7 @@ vector<image3f*> get_textures(Scene* scene) {
         if(surface->mat->ks_txt) textures.insert(surface->mat->ks_txt);
         if(surface->mat->norm_txt) textures.insert(surface->mat->norm_txt);
     }
-    return vector<image3f*>(textures.begin(),textures.end());
+    return vector<Texture*>(textures.begin(),textures.end());
 }
 
 Camera* lookat_camera(vec3f eye, vec3f center, vec3f up, float width, float height, float dist) {
@@ -53,11 +68,13 @@ void set_view_turntable(Camera* camera, float rotate_phi, float rotate_theta, fl
 
 void json_set_values(const jsonvalue& json, float* value, int n) {
     error_if_not(n == json.array_size(), "incorrect array size");
-    for(auto i : range(n)) value[i] = json.array_element(i).as_float();
+    if(json.is_numarray()) { auto& numbers = json.as_numarray_ref(); for(auto i : range(n)) value[i] = numbers[i]; }
+    else for(auto i : range(n)) value[i] = json.array_element(i).as_float();
 }
 void json_set_values(const jsonvalue& json, int* value, int n) {
     error_if_not(n == json.array_size(), "incorrect array size");
-    for(auto i : range(n)) value[i] = json.array_element(i).as_int();
+    if(json.is_numarray()) { auto& numbers = json.as_numarray_ref(); for(auto i : range(n)) value[i] = (int)numbers[i]; }
+    else for(auto i : range(n)) value[i] = json.array_element(i).as_int();
 }
 
 void json_set_value(const jsonvalue& json, bool& value)  { value = json.as_bool(); }
@@ -109,6 +126,36 @@ void json_set_optvalue(const jsonvalue& json, T& value, const string& name) {
     json_set_value(json.object_element(name), value);
 }
 
+// streaming versions of json_set_value that parse arrays directly into their destination
+void json_read_values(JsonReader& reader, float* value, int n) {
+    reader.begin_array();
+    for(auto i : range(n)) { error_if_not(reader.next_element(), "incorrect array size"); value[i] = reader.read_number(); }
+    error_if_not(not reader.next_element(), "incorrect array size");
+}
+void json_read_values(JsonReader& reader, int* value, int n) {
+    reader.begin_array();
+    for(auto i : range(n)) { error_if_not(reader.next_element(), "incorrect array size"); value[i] = (int)reader.read_number(); }
+    error_if_not(not reader.next_element(), "incorrect array size");
+}
+
+void json_read_value(JsonReader& reader, float& value) { value = reader.read_number(); }
+void json_read_value(JsonReader& reader, vec2i& value) { json_read_values(reader, &value.x, 2); }
+void json_read_value(JsonReader& reader, vector<bool>& value) { reader.read_array(value); }
+void json_read_value(JsonReader& reader, vector<float>& value) { reader.read_array<float,1>(value); }
+void json_read_value(JsonReader& reader, vector<vec2f>& value) { reader.read_array<float,2>(value); }
+void json_read_value(JsonReader& reader, vector<vec3f>& value) { reader.read_array<float,3>(value); }
+void json_read_value(JsonReader& reader, vector<vec4f>& value) { reader.read_array<float,4>(value); }
+void json_read_value(JsonReader& reader, vector<int>& value)   { reader.read_array<int,1>(value); }
+void json_read_value(JsonReader& reader, vector<vec2i>& value) { reader.read_array<int,2>(value); }
+void json_read_value(JsonReader& reader, vector<vec3i>& value) { reader.read_array<int,3>(value); }
+void json_read_value(JsonReader& reader, vector<vec4i>& value) { reader.read_array<int,4>(value); }
+void json_read_value(JsonReader& reader, vector<mat4f>& value) { reader.read_array<float,16>(value); }
+void json_read_value(JsonReader& reader, vector<vector<mat4f>>& value) {
+    value.clear();
+    reader.begin_array();
+    while(reader.next_element()) { value.push_back(vector<mat4f>()); json_read_value(reader, value.back()); }
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -137,42 +184,36 @@ Camera* json_parse_lookatcamera(const jsonvalue& json) {
     return lookat_camera(from, to, up, width, height, dist);
 }
 
-vector<string>          json_texture_paths;
-map<string,image3f*>    json_texture_cache;
-
-void json_texture_path_push(string filename) {
+// directory of a file, used to resolve the paths it references
+string json_dirname(const string& filename) {
     auto pos = filename.rfind("/");
-    auto dirname = (pos == string::npos) ? string() : filename.substr(0,pos+1);
-    json_texture_paths.push_back(dirname);
+    return (pos == string::npos) ? string() : filename.substr(0,pos+1);
+}
+
+// path of a file referenced by a json, relative to dirname unless absolute
+string json_filepath(const string& dirname, const string& filename) {
+    if(filename.empty() or filename[0] == '/' or filename[0] == '\\' or (filename.size() > 1 and filename[1] == ':')) return filename;
+    return dirname + filename;
 }
-void json_texture_path_pop() { json_texture_paths.pop_back(); }
 
-void json_parse_opttexture(jsonvalue json, image3f*& txt, string name) {
+// parse a texture whose path is relative to dirname (textures are shared through the texture cache)
+void json_parse_opttexture(const jsonvalue& json, Texture*& txt, const string& name, const string& dirname) {
     if(not json.object_contains(name)) return;
     auto filename = json.object_element(name).as_string();
-    if(filename.empty()) { txt = nullptr; return; }
-    auto dirname = json_texture_paths.back();
-    auto fullname = dirname + filename;
-    if (json_texture_cache.find(fullname) == json_texture_cache.end()) {
-        auto ext = fullname.substr(fullname.size()-3);
-        if(ext == "pfm") {
-            auto image = read_pnm("models/pisa_latlong.pfm", true);
-            image = image.gamma(1/2.2);
-            json_texture_cache[fullname] = new image3f(image);
-        } else if(ext == "png") {
-            auto image = read_png(fullname,true);
-            json_texture_cache[fullname] = new image3f(image);
-        } else error("unsupported image format %s\n", ext.c_str());
-    }
-    txt = json_texture_cache[fullname];
-}
-
-Material* json_parse_material(const jsonvalue& json) {
+    txt = (filename.empty()) ? nullptr : acquire_texture(json_filepath(dirname, filename));
+}
+
+Material* json_parse_material(const jsonvalue& json, const string& dirname) {
     auto material = new Material();
     json_set_optvalue(json, material->kd, "kd");
     json_set_optvalue(json, material->ks, "ks");
     json_set_optvalue(json, material->kr, "kr");
     json_set_optvalue(json, material->n, "n");
+    json_parse_opttexture(json, material->kd_txt, "kd_txt", dirname);
+    json_parse_opttexture(json, material->ks_txt, "ks_txt", dirname);
+    json_parse_opttexture(json, material->kr_txt, "kr_txt", dirname);
+    json_parse_opttexture(json, material->norm_txt, "norm_txt", dirname);
+    json_parse_opttexture(json, material->ke_txt, "ke_txt", dirname);
     return material;
 }
 
@@ -185,21 +226,22 @@ FrameAnimation* json_parse_frame_animation(const jsonvalue& json) {
     return animation;
 }
 
-Surface* json_parse_surface(const jsonvalue& json) {
+// textures are relative to dirname, the directory of the file the json comes from
+Surface* json_parse_surface(const jsonvalue& json, const string& dirname) {
     auto surface = new Surface();
     json_set_optvalue(json, surface->frame, "frame");
     json_set_optvalue(json, surface->radius,"radius");
     json_set_optvalue(json, surface->isquad,"isquad");
-    if(json.object_contains("material")) surface->mat = json_parse_material(json.object_element("material"));
+    if(json.object_contains("material")) surface->mat = json_parse_material(json.object_element("material"), dirname);
     json_set_optvalue(json, surface->subdivision_level,"subdivision_level");
     json_set_optvalue(json, surface->subdivision_smooth,"subdivision_smooth");
     if(json.object_contains("animation")) surface->animation = json_parse_frame_animation(json.object_element("animation"));
     return surface;
 }
 
-vector<Surface*> json_parse_surfaces(const jsonvalue& json) {
+vector<Surface*> json_parse_surfaces(const jsonvalue& json, const string& dirname) {
     vector<Surface*> surfaces;
-    for(auto value : json.as_array_ref()) surfaces.push_back( json_parse_surface(value) );
+    for(auto& value : json.as_array_ref()) surfaces.push_back( json_parse_surface(value, dirname) );
     return surfaces;
 }
 
@@ -235,13 +277,72 @@ MeshSimulation* json_parse_mesh_simulation(const jsonvalue& json) {
     return simulation;
 }
 
-Mesh* json_parse_mesh(const jsonvalue& json) {
-    auto mesh = new Mesh();
-    if(json.object_contains("json_mesh")) {
-        json_texture_path_push(json.object_element("json_mesh").as_string());
-        mesh = json_parse_mesh(load_json(json.object_element("json_mesh").as_string()));
-        json_texture_path_pop();
+// streaming skinning reader
+MeshSkinning* json_read_mesh_skinning(JsonReader& reader) {
+    auto skinning = new MeshSkinning();
+    auto key = string();
+    reader.begin_object();
+    while(reader.next_key(key)) {
+        if(key == "rest_pos") json_read_value(reader, skinning->rest_pos);
+        else if(key == "rest_norm") json_read_value(reader, skinning->rest_norm);
+        else if(key == "bone_ids") json_read_value(reader, skinning->bone_ids);
+        else if(key == "bone_weights") json_read_value(reader, skinning->bone_weights);
+        else if(key == "bone_xforms") json_read_value(reader, skinning->bone_xforms);
+        else reader.skip_value();
     }
+    return skinning;
+}
+
+// streaming simulation reader
+MeshSimulation* json_read_mesh_simulation(JsonReader& reader) {
+    auto simulation = new MeshSimulation();
+    auto key = string();
+    reader.begin_object();
+    while(reader.next_key(key)) {
+        if(key == "init_pos") json_read_value(reader, simulation->init_pos);
+        else if(key == "init_vel") json_read_value(reader, simulation->init_vel);
+        else if(key == "mass") json_read_value(reader, simulation->mass);
+        else if(key == "pinned") json_read_value(reader, simulation->pinned);
+        else if(key == "vel") json_read_value(reader, simulation->vel);
+        else if(key == "force") json_read_value(reader, simulation->force);
+        else if(key == "springs") {
+            reader.begin_array();
+            while(reader.next_element()) {
+                auto spring = MeshSimulation::Spring();
+                reader.begin_object();
+                while(reader.next_key(key)) {
+                    if(key == "ids") json_read_value(reader, spring.ids);
+                    else if(key == "restlength") json_read_value(reader, spring.restlength);
+                    else if(key == "ks") json_read_value(reader, spring.ks);
+                    else if(key == "kd") json_read_value(reader, spring.kd);
+                    else reader.skip_value();
+                }
+                simulation->springs.push_back(spring);
+            }
+        }
+        else reader.skip_value();
+    }
+    return simulation;
+}
+
+// append the textures of a material
+static void _material_textures(Material* mat, vector<Texture*>& textures) {
+    for(auto texture : {mat->kd_txt, mat->ks_txt, mat->kr_txt, mat->norm_txt, mat->ke_txt})
+        if(texture) textures.push_back(texture);
+}
+
+// release the textures of a material and free it
+static void _delete_material(Material* mat) {
+    auto textures = vector<Texture*>();
+    _material_textures(mat, textures);
+    for(auto texture : textures) release_texture(texture);
+    delete mat;
+}
+
+// parse mesh properties into an existing mesh, replacing (and freeing) the values it overrides
+// skinning, if given, was already loaded from the json_skinning or bin_skinning file
+// textures and files are relative to dirname, the directory of the file the json comes from
+void json_parse_mesh(const jsonvalue& json, Mesh* mesh, MeshSkinning* skinning = nullptr, const string& dirname = "") {
     json_set_optvalue(json, mesh->frame, "frame");
     json_set_optvalue(json, mesh->pos, "pos");
     json_set_optvalue(json, mesh->norm, "norm");
@@ -251,31 +352,419 @@ Mesh* json_parse_mesh(const jsonvalue& json) {
     json_set_optvalue(json, mesh->point, "point");
     json_set_optvalue(json, mesh->line, "line");
     json_set_optvalue(json, mesh->spline, "spline");
-    if(json.object_contains("material")) mesh->mat = json_parse_material(json.object_element("material"));
+    if(json.object_contains("material")) {
+        auto mat = json_parse_material(json.object_element("material"), dirname);
+        _delete_material(mesh->mat);
+        mesh->mat = mat;
+    }
     json_set_optvalue(json, mesh->subdivision_catmullclark_level, "subdivision_catmullclark_level");
     json_set_optvalue(json, mesh->subdivision_catmullclark_smooth, "subdivision_catmullclark_smooth");
+    json_set_optvalue(json, mesh->subdivision_catmullclark_adaptive, "subdivision_catmullclark_adaptive");
+    json_set_optvalue(json, mesh->subdivision_catmullclark_adaptive_angle, "subdivision_catmullclark_adaptive_angle");
+    json_set_optvalue(json, mesh->subdivision_catmullclark_adaptive_area, "subdivision_catmullclark_adaptive_area");
     json_set_optvalue(json, mesh->subdivision_bezier_level, "subdivision_bezier_level");
     json_set_optvalue(json, mesh->subdivision_bezier_uniform, "subdivision_bezier_uniform");
-    if(json.object_contains("animation")) mesh->animation = json_parse_frame_animation(json.object_element("animation"));
-    if(json.object_contains("skinning")) mesh->skinning = json_parse_mesh_skinning(json.object_element("skinning"));
-    if(json.object_contains("json_skinning")) mesh->skinning = json_parse_mesh_skinning(load_json(json.object_element("json_skinning").as_string()));
-    if(json.object_contains("simulation")) mesh->simulation = json_parse_mesh_simulation(json.object_element("simulation"));
+    json_set_optvalue(json, mesh->subdivision_bezier_tolerance, "subdivision_bezier_tolerance");
+    if(json.object_contains("animation")) {
+        delete mesh->animation;
+        mesh->animation = json_parse_frame_animation(json.object_element("animation"));
+    }
+    if(not skinning and json.object_contains("skinning")) skinning = json_parse_mesh_skinning(json.object_element("skinning"));
+    if(not skinning and json.object_contains("json_skinning"))
+        skinning = load_json_mesh_skinning(json_filepath(dirname, json.object_element("json_skinning").as_string()));
+    else if(not skinning and json.object_contains("bin_skinning")) {
+        auto stream = false;
+        json_set_optvalue(json, stream, "bone_xforms_stream");
+        skinning = load_bin_mesh_skinning(json_filepath(dirname, json.object_element("bin_skinning").as_string()), stream);
+    }
+    if(skinning and skinning != mesh->skinning) {
+        delete mesh->skinning;
+        mesh->skinning = skinning;
+    }
+    if(json.object_contains("simulation")) {
+        delete mesh->simulation;
+        mesh->simulation = json_parse_mesh_simulation(json.object_element("simulation"));
+    }
     if (mesh->skinning) {
         if (mesh->skinning->rest_pos.empty()) mesh->skinning->rest_pos = mesh->pos;
         if (mesh->skinning->rest_norm.empty()) mesh->skinning->rest_norm = mesh->norm;
         if (mesh->pos.empty()) mesh->pos = mesh->skinning->rest_pos;
         if (mesh->norm.empty()) mesh->norm = mesh->skinning->rest_norm;
     }
+}
+
+MeshSkinning* load_json_mesh_skinning(const string& filename) {
+    auto reader = JsonReader(filename);
+    return json_read_mesh_skinning(reader);
+}
+
+Mesh* load_json_mesh(const string& filename, jsonvalue* meta) {
+    auto mesh = new Mesh();
+    auto reader = JsonReader(filename);
+    // large arrays are streamed, while the remaining small values are collected and parsed as usual
+    auto json = jsonvalue::object();
+    auto key = string();
+    reader.begin_object();
+    while(reader.next_key(key)) {
+        if(key == "pos") json_read_value(reader, mesh->pos);
+        else if(key == "norm") json_read_value(reader, mesh->norm);
+        else if(key == "texcoord") json_read_value(reader, mesh->texcoord);
+        else if(key == "triangle") json_read_value(reader, mesh->triangle);
+        else if(key == "quad") json_read_value(reader, mesh->quad);
+        else if(key == "point") json_read_value(reader, mesh->point);
+        else if(key == "line") json_read_value(reader, mesh->line);
+        else if(key == "spline") json_read_value(reader, mesh->spline);
+        else if(key == "skinning") mesh->skinning = json_read_mesh_skinning(reader);
+        else if(key == "simulation") mesh->simulation = json_read_mesh_simulation(reader);
+        else json[key] = reader.read_value();
+    }
+    auto values = jsonvalue(std::move(json));
+    json_parse_mesh(values, mesh, nullptr, json_dirname(filename));
+    if(meta) *meta = std::move(values);
     return mesh;
 }
 
-vector<Mesh*> json_parse_meshes(const jsonvalue& json) {
-    auto meshes = vector<Mesh*>();
-    for(auto& value : json.as_array_ref())
-        meshes.push_back( json_parse_mesh(value) );
+// binary sections of a skinning, named after their json path
+void bin_read_mesh_skinning(const BinaryFile& bin, const string& prefix, MeshSkinning* skinning, bool bone_xforms = true) {
+    bin.read<float,3>(prefix+"rest_pos", skinning->rest_pos);
+    bin.read<float,3>(prefix+"rest_norm", skinning->rest_norm);
+    bin.read<int,4>(prefix+"bone_ids", skinning->bone_ids);
+    bin.read<float,4>(prefix+"bone_weights", skinning->bone_weights);
+    if(bone_xforms) bin.read<float,16>(prefix+"bone_xforms", skinning->bone_xforms);
+}
+void bin_write_mesh_skinning(BinaryWriter& bin, const string& prefix, const MeshSkinning* skinning) {
+    bin.add<float,3>(prefix+"rest_pos", skinning->rest_pos);
+    bin.add<float,3>(prefix+"rest_norm", skinning->rest_norm);
+    bin.add<int,4>(prefix+"bone_ids", skinning->bone_ids);
+    bin.add<float,4>(prefix+"bone_weights", skinning->bone_weights);
+    bin.add<float,16>(prefix+"bone_xforms", skinning->bone_xforms);
+}
+
+// binary sections of a simulation; springs are stored as one section per field
+// (spring ids are checked against the nverts vertices of the mesh)
+void bin_read_mesh_simulation(const BinaryFile& bin, const string& prefix, MeshSimulation* simulation, int nverts) {
+    bin.read<float,3>(prefix+"init_pos", simulation->init_pos);
+    bin.read<float,3>(prefix+"init_vel", simulation->init_vel);
+    bin.read<float,1>(prefix+"mass", simulation->mass);
+    bin.read(prefix+"pinned", simulation->pinned);
+    bin.read<float,3>(prefix+"vel", simulation->vel);
+    bin.read<float,3>(prefix+"force", simulation->force);
+    if(not bin.has_section(prefix+"springs.ids")) return;
+    auto count = 0, restlength_count = 0, ks_count = 0, kd_count = 0;
+    auto ids = bin.view<int,2,vec2i>(prefix+"springs.ids", count);
+    auto restlength = bin.view<float,1,float>(prefix+"springs.restlength", restlength_count);
+    auto ks = bin.view<float,1,float>(prefix+"springs.ks", ks_count);
+    auto kd = bin.view<float,1,float>(prefix+"springs.kd", kd_count);
+    error_if_not(restlength_count == count and ks_count == count and kd_count == count,
+                 "corrupted binary file: spring sections of different size in %s\n", bin._filename.c_str());
+    simulation->springs.resize(count);
+    for(auto i : range(count)) {
+        auto& spring = simulation->springs[i];
+        spring.ids = ids[i]; spring.restlength = restlength[i]; spring.ks = ks[i]; spring.kd = kd[i];
+        error_if_not(spring.ids.x >= 0 and spring.ids.x < nverts and spring.ids.y >= 0 and spring.ids.y < nverts,
+                     "corrupted binary file: spring vertex out of range in %s\n", bin._filename.c_str());
+    }
+}
+void bin_write_mesh_simulation(BinaryWriter& bin, const string& prefix, const MeshSimulation* simulation) {
+    bin.add<float,3>(prefix+"init_pos", simulation->init_pos);
+    bin.add<float,3>(prefix+"init_vel", simulation->init_vel);
+    bin.add<float,1>(prefix+"mass", simulation->mass);
+    bin.add(prefix+"pinned", simulation->pinned);
+    bin.add<float,3>(prefix+"vel", simulation->vel);
+    bin.add<float,3>(prefix+"force", simulation->force);
+    auto ids = vector<vec2i>(); auto restlength = vector<float>(); auto ks = vector<float>(); auto kd = vector<float>();
+    for(auto& spring : simulation->springs) {
+        ids.push_back(spring.ids); restlength.push_back(spring.restlength); ks.push_back(spring.ks); kd.push_back(spring.kd);
+    }
+    bin.add<int,2>(prefix+"springs.ids", ids);
+    bin.add<float,1>(prefix+"springs.restlength", restlength);
+    bin.add<float,1>(prefix+"springs.ks", ks);
+    bin.add<float,1>(prefix+"springs.kd", kd);
+}
+
+// whether any section name starts with prefix
+bool bin_has_prefix(const BinaryFile& bin, const string& prefix) {
+    for(auto& sec : bin._sections) if(string(sec.name).compare(0, prefix.size(), prefix) == 0) return true;
+    return false;
+}
+
+// load a binary mesh whose textures are relative to dirname
+Mesh* load_bin_mesh(const string& filename, const string& dirname) {
+    auto mesh = new Mesh();
+    auto bin = BinaryFile(filename);
+    bin.read<float,3>("pos", mesh->pos);
+    bin.read<float,3>("norm", mesh->norm);
+    bin.read<float,2>("texcoord", mesh->texcoord);
+    bin.read<int,3>("triangle", mesh->triangle);
+    bin.read<int,4>("quad", mesh->quad);
+    bin.read<int,1>("point", mesh->point);
+    bin.read<int,2>("line", mesh->line);
+    bin.read<int,4>("spline", mesh->spline);
+    if(bin_has_prefix(bin, "skinning.")) {
+        mesh->skinning = new MeshSkinning();
+        bin_read_mesh_skinning(bin, "skinning.", mesh->skinning);
+    }
+    if(bin_has_prefix(bin, "simulation.")) {
+        mesh->simulation = new MeshSimulation();
+        bin_read_mesh_simulation(bin, "simulation.", mesh->simulation, mesh->pos.size());
+    }
+    // remaining small values are stored as json
+    auto meta = bin.read_text("meta");
+    json_parse_mesh((meta.empty()) ? jsonvalue(jsonvalue::object()) : parse_json(meta), mesh, nullptr, dirname);
+    return mesh;
+}
+
+Mesh* load_bin_mesh(const string& filename) { return load_bin_mesh(filename, json_dirname(filename)); }
+
+// bone xforms paged in from the bone_xforms section of a binary skinning file;
+// a background thread reads ahead the frames following the last one requested,
+// keeping at most window frames in memory (animations loop, so the window wraps around)
+struct BoneXformStream {
+    string                      filename;           // binary skinning file
+    FILE*                       file = nullptr;     // file handle (used under file_mutex)
+    uint64_t                    offset = 0;         // offset of the first frame
+    int                         frames = 0;         // number of frames
+    int                         bones = 0;          // number of bones per frame
+    int                         window = 0;         // frames to keep in memory
+    
+    map<int,std::shared_ptr<const vector<mat4f>>>   cache;  // frames in memory
+    int                         requested = 0;      // last frame requested
+    bool                        stop = false;       // whether to stop the read-ahead thread
+    std::shared_ptr<const vector<mat4f>>            current;// last frame returned (kept alive if evicted)
+    
+    std::mutex                  mutex;              // guards cache, requested and stop
+    std::mutex                  file_mutex;         // guards file
+    std::condition_variable     wakeup;             // signals a new request
+    std::thread                 thread;             // read-ahead thread
+    
+    BoneXformStream(const string& filename, int window = 32) : filename(filename), window(window) {
+        for(auto& sec : read_binary_sections(filename)) {
+            if(string(sec.name) != "bone_xforms") continue;
+            error_if_not(sec.type == bin_float and sec.components == 16, "wrong section type bone_xforms in %s\n", filename.c_str());
+            offset = sec.offset;
+            frames = sec.rows;
+            bones = sec.count / sec.rows;
+        }
+        error_if_not(frames > 0, "missing section bone_xforms in %s\n", filename.c_str());
+        file = fopen(filename.c_str(), "rb");
+        error_if_not(file, "cannot open file: %s\n", filename.c_str());
+        thread = std::thread([this](){ _read_ahead(); });
+    }
+    
+    ~BoneXformStream() {
+        { std::lock_guard<std::mutex> lock(mutex); stop = true; }
+        wakeup.notify_one();
+        thread.join();
+        fclose(file);
+    }
+    
+    // bone xforms of a frame, read now if not already in memory (cached frames are shared, not copied)
+    const vector<mat4f>& get(int frame) {
+        frame = frame % frames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requested = frame;
+            auto it = cache.find(frame);
+            current = (it != cache.end()) ? it->second : nullptr;
+        }
+        if(not current) current = _read(frame);
+        wakeup.notify_one();
+        return *current;
+    }
+    
+    // read a frame from disk (with 64-bit offsets, since long clips exceed 2GB)
+    std::shared_ptr<const vector<mat4f>> _read(int frame) {
+        auto xforms = std::make_shared<vector<mat4f>>(bones);
+        auto pos = offset + (uint64_t)frame*bones*sizeof(mat4f);
+        std::lock_guard<std::mutex> lock(file_mutex);
+#ifdef _WIN32
+        auto ok = _fseeki64(file, (int64_t)pos, SEEK_SET) == 0;
+#else
+        auto ok = fseeko(file, (off_t)pos, SEEK_SET) == 0;
+#endif
+        ok = ok and fread(xforms->data(), sizeof(mat4f), bones, file) == (size_t)bones;
+        error_if_not(ok, "cannot read file: %s\n", filename.c_str());
+        return xforms;
+    }
+    
+    // whether a frame is in the window that starts at the requested frame
+    bool _in_window(int frame) const { return (frame - requested + frames) % frames < window; }
+    
+    // read-ahead loop: fill the window after the requested frame and evict frames outside it
+    void _read_ahead() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(not stop) {
+            for(auto it = cache.begin(); it != cache.end(); ) {
+                if(_in_window(it->first)) ++it; else it = cache.erase(it);
+            }
+            auto next = -1;
+            for(auto i : range(std::min(window,frames))) {
+                auto frame = (requested + i) % frames;
+                if(cache.find(frame) == cache.end()) { next = frame; break; }
+            }
+            if(next < 0) { wakeup.wait(lock); continue; }
+            lock.unlock();
+            auto xforms = _read(next);
+            lock.lock();
+            if(_in_window(next)) cache[next] = xforms;
+        }
+    }
+};
+
+MeshSkinning::~MeshSkinning() {
+    delete bone_xforms_stream;
+}
+
+const vector<mat4f>& get_bone_xforms(MeshSkinning* skinning, int frame) {
+    if(skinning->bone_xforms_stream) return skinning->bone_xforms_stream->get(frame);
+    return skinning->bone_xforms[frame];
+}
+
+MeshSkinning* load_bin_mesh_skinning(const string& filename, bool stream_bone_xforms) {
+    auto skinning = new MeshSkinning();
+    auto bin = BinaryFile(filename);
+    bin_read_mesh_skinning(bin, "", skinning, not stream_bone_xforms);
+    if(stream_bone_xforms) skinning->bone_xforms_stream = new BoneXformStream(filename);
+    return skinning;
+}
+
+void save_bin_mesh(const string& filename, const Mesh* mesh, const jsonvalue& meta) {
+    auto bin = BinaryWriter();
+    bin.add<float,3>("pos", mesh->pos);
+    bin.add<float,3>("norm", mesh->norm);
+    bin.add<float,2>("texcoord", mesh->texcoord);
+    bin.add<int,3>("triangle", mesh->triangle);
+    bin.add<int,4>("quad", mesh->quad);
+    bin.add<int,1>("point", mesh->point);
+    bin.add<int,2>("line", mesh->line);
+    bin.add<int,4>("spline", mesh->spline);
+    if(mesh->skinning) bin_write_mesh_skinning(bin, "skinning.", mesh->skinning);
+    if(mesh->simulation) bin_write_mesh_simulation(bin, "simulation.", mesh->simulation);
+    if(not meta.is_null()) bin.add_text("meta", format_json(meta));
+    bin.save(filename);
+}
+
+void save_bin_mesh_skinning(const string& filename, const MeshSkinning* skinning) {
+    auto bin = BinaryWriter();
+    bin_write_mesh_skinning(bin, "", skinning);
+    bin.save(filename);
+}
+
+// stamp of a file (modification time and size), zero if missing
+static pair<int64_t,int64_t> _file_stamp(const string& filename) {
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0) return pair<int64_t,int64_t>(0,0);
+    // nanoseconds where available, so that quick successive saves are told apart
+#if defined(_WIN32)
+    auto mtime = (int64_t)st.st_mtime * 1000000000;
+#elif defined(__APPLE__)
+    auto mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    auto mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return pair<int64_t,int64_t>(mtime, st.st_size);
+}
+
+// cache file name for a json file, keyed by its contents; the key of each file is remembered with
+// its stamp, so a file is read and hashed again only when its size or modification time change
+string asset_cache_json_filename(const string& filename, const string& ext) {
+    if(not asset_cache_enabled()) return string();
+    static std::mutex keys_mutex;
+    static map<string,pair<pair<int64_t,int64_t>,uint64_t>> keys;  // stamp and key of the files hashed so far
+    // the stamp is taken before reading, so that a file changed meanwhile is hashed again next time
+    auto stamp = _file_stamp(filename);
+    {
+        std::lock_guard<std::mutex> lock(keys_mutex);
+        auto it = keys.find(filename);
+        if(it != keys.end() and it->second.first == stamp) return asset_cache_filename(it->second.second, ext);
+    }
+    auto data = load_binary_file(filename);
+    auto key = hash_value((int)BINARY_VERSION, hash_bytes(data.data(), data.size()));
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    keys[filename] = make_pair(stamp, key);
+    return asset_cache_filename(key, ext);
+}
+
+// load a json mesh through the asset cache
+Mesh* load_json_mesh_cached(const string& filename) {
+    auto cachename = asset_cache_json_filename(filename, "mesh.bin");
+    if(cachename.empty()) return load_json_mesh(filename);
+    if(asset_cache_contains(cachename)) return load_bin_mesh(cachename, json_dirname(filename));
+    auto meta = jsonvalue();
+    auto mesh = load_json_mesh(filename, &meta);
+    auto tmpname = asset_cache_tmpname(cachename);
+    save_bin_mesh(tmpname, mesh, meta);
+    asset_cache_commit(tmpname, cachename);
+    return mesh;
+}
+
+// load a json skinning through the asset cache
+MeshSkinning* load_json_mesh_skinning_cached(const string& filename) {
+    auto cachename = asset_cache_json_filename(filename, "skin.bin");
+    if(cachename.empty()) return load_json_mesh_skinning(filename);
+    if(asset_cache_contains(cachename)) return load_bin_mesh_skinning(cachename);
+    auto skinning = load_json_mesh_skinning(filename);
+    auto tmpname = asset_cache_tmpname(cachename);
+    save_bin_mesh_skinning(tmpname, skinning);
+    asset_cache_commit(tmpname, cachename);
+    return skinning;
+}
+
+// add tasks that load the files referenced by a mesh json, relative to dirname, setting mesh and skinning
+void json_mesh_load_tasks(const jsonvalue& json, const string& dirname, Mesh*& mesh, MeshSkinning*& skinning, vector<std::function<void()>>& tasks) {
+    if(json.object_contains("json_mesh")) {
+        auto filename = json_filepath(dirname, json.object_element("json_mesh").as_string());
+        tasks.push_back([filename,&mesh](){ mesh = load_json_mesh_cached(filename); });
+    } else if(json.object_contains("bin_mesh")) {
+        auto filename = json_filepath(dirname, json.object_element("bin_mesh").as_string());
+        tasks.push_back([filename,&mesh](){ mesh = load_bin_mesh(filename); });
+    }
+    if(json.object_contains("json_skinning")) {
+        auto filename = json_filepath(dirname, json.object_element("json_skinning").as_string());
+        tasks.push_back([filename,&skinning](){ skinning = load_json_mesh_skinning_cached(filename); });
+    } else if(json.object_contains("bin_skinning")) {
+        auto filename = json_filepath(dirname, json.object_element("bin_skinning").as_string());
+        auto stream = false;
+        json_set_optvalue(json, stream, "bone_xforms_stream");
+        tasks.push_back([filename,stream,&skinning](){ skinning = load_bin_mesh_skinning(filename, stream); });
+    }
+}
+
+Mesh* json_parse_mesh(const jsonvalue& json, const string& dirname) {
+    auto mesh = (Mesh*)nullptr;
+    auto skinning = (MeshSkinning*)nullptr;
+    auto tasks = vector<std::function<void()>>();
+    json_mesh_load_tasks(json, dirname, mesh, skinning, tasks);
+    for(auto& task : tasks) task();
+    if(not mesh) mesh = new Mesh();
+    json_parse_mesh(json, mesh, skinning, dirname);
+    return mesh;
+}
+
+// referenced files of all meshes are loaded concurrently, one file per task,
+// then each mesh is assembled in its own slot (decoding its textures), also concurrently
+// (files and textures in the json are relative to dirname, the directory of the file the json comes from)
+vector<Mesh*> json_parse_meshes(const vector<const jsonvalue*>& values, const string& dirname) {
+    auto meshes = vector<Mesh*>(values.size(), nullptr);
+    auto skinnings = vector<MeshSkinning*>(values.size(), nullptr);
+    auto tasks = vector<std::function<void()>>();
+    for(auto i : range(values.size())) json_mesh_load_tasks(*values[i], dirname, meshes[i], skinnings[i], tasks);
+    parallel_for(tasks.size(), [&tasks](int start, int end){ for(auto t : range(start,end)) tasks[t](); }, 1);
+    parallel_for(values.size(), [&](int start, int end){
+        for(auto i : range(start,end)) {
+            if(not meshes[i]) meshes[i] = new Mesh();
+            json_parse_mesh(*values[i], meshes[i], skinnings[i], dirname);
+        }
+    }, 1);
     return meshes;
 }
 
+vector<Mesh*> json_parse_meshes(const jsonvalue& json, const string& dirname) {
+    auto values = vector<const jsonvalue*>();
+    for(auto& value : json.as_array_ref()) values.push_back(&value);
+    return json_parse_meshes(values, dirname);
+}
+
 Light* json_parse_light(const jsonvalue& json) {
     auto light = new Light();
     json_set_optvalue(json, light->frame, "frame");
@@ -301,22 +790,23 @@ SceneAnimation* json_parse_scene_animation(const jsonvalue& json) {
     return animation;
 }
 
-Scene* json_parse_scene(const jsonvalue& json) {
+// paths in the scene (textures and mesh, skinning and json_meshes files) are relative to dirname,
+// the directory of the scene file; paths inside a json_meshes or json_mesh file are relative to that file
+Scene* json_parse_scene(const jsonvalue& json, const string& dirname) {
     // prepare scene
     auto scene = new Scene();
     // camera
     if (json.object_contains("camera")) scene->camera = json_parse_camera(json.object_element("camera"));
     if (json.object_contains("lookat_camera")) scene->camera = json_parse_lookatcamera(json.object_element("lookat_camera"));
     // surfaces
-    if(json.object_contains("surfaces")) scene->surfaces = json_parse_surfaces(json.object_element("surfaces"));
+    if(json.object_contains("surfaces")) scene->surfaces = json_parse_surfaces(json.object_element("surfaces"), dirname);
     // meshes
     if(json.object_contains("json_meshes")) {
-        json_texture_path_push(json.object_element("json_meshes").as_string());
-        scene->meshes = json_parse_meshes(load_json(json.object_element("json_meshes").as_string()));
-        json_texture_path_pop();
+        auto filename = json_filepath(dirname, json.object_element("json_meshes").as_string());
+        scene->meshes = json_parse_meshes(load_json(filename), json_dirname(filename));
     }
     if(json.object_contains("meshes")) {
-        scene->meshes = json_parse_meshes(json.object_element("meshes"));
+        scene->meshes = json_parse_meshes(json.object_element("meshes"), dirname);
     }
     // lights
     if(json.object_contains("lights")) scene->lights = json_parse_lights(json.object_element("lights"));
@@ -333,14 +823,519 @@ Scene* json_parse_scene(const jsonvalue& json) {
 }
 
 Scene* load_json_scene(const string& filename) {
-    json_texture_cache.clear();
-    json_texture_paths = { "" };
-    auto scene = json_parse_scene(load_json(filename));
-    json_texture_cache.clear();
-    json_texture_paths = { "" };
+    return json_parse_scene(load_json(filename), json_dirname(filename));
+}
+
+// the parsers and loaders stop the program on malformed values, so values and files that may be
+// malformed are checked beforehand against what they read, as described by the tables below
+
+// shape of a json value read by the parsers
+enum JsonShape {
+    shape_bool,         // bool
+    shape_number,       // number
+    shape_string,       // string
+    shape_vector,       // array of size numbers
+    shape_numbers,      // array of numbers, a multiple of size of them
+    shape_rows,         // array of arrays of numbers, each a multiple of size of them
+    shape_bools,        // array of bools
+    shape_object,       // object with the given fields
+    shape_objects,      // array of objects with the given fields
+};
+
+// field of a json object read by the parsers (other fields are ignored)
+struct JsonField {
+    string                      name;       // key
+    JsonShape                   shape;      // shape of the value
+    int                         size;       // number of values (see JsonShape)
+    const vector<JsonField>*    fields;     // fields of objects (see JsonShape)
+};
+
+static const vector<JsonField> _frame_fields = {
+    {"from", shape_vector, 3, nullptr}, {"to", shape_vector, 3, nullptr}, {"up", shape_vector, 3, nullptr},
+    {"o", shape_vector, 3, nullptr}, {"x", shape_vector, 3, nullptr}, {"y", shape_vector, 3, nullptr}, {"z", shape_vector, 3, nullptr} };
+static const vector<JsonField> _material_fields = {
+    {"kd", shape_vector, 3, nullptr}, {"ks", shape_vector, 3, nullptr}, {"kr", shape_vector, 3, nullptr}, {"n", shape_number, 1, nullptr},
+    {"kd_txt", shape_string, 1, nullptr}, {"ks_txt", shape_string, 1, nullptr}, {"kr_txt", shape_string, 1, nullptr},
+    {"norm_txt", shape_string, 1, nullptr}, {"ke_txt", shape_string, 1, nullptr} };
+static const vector<JsonField> _frame_animation_fields = {
+    {"rest_frame", shape_object, 1, &_frame_fields}, {"keytimes", shape_numbers, 1, nullptr},
+    {"translation", shape_numbers, 3, nullptr}, {"rotation", shape_numbers, 3, nullptr} };
+static const vector<JsonField> _skinning_fields = {
+    {"rest_pos", shape_numbers, 3, nullptr}, {"rest_norm", shape_numbers, 3, nullptr}, {"bone_ids", shape_numbers, 4, nullptr},
+    {"bone_weights", shape_numbers, 4, nullptr}, {"bone_xforms", shape_rows, 16, nullptr} };
+static const vector<JsonField> _spring_fields = {
+    {"ids", shape_vector, 2, nullptr}, {"restlength", shape_number, 1, nullptr}, {"ks", shape_number, 1, nullptr}, {"kd", shape_number, 1, nullptr} };
+static const vector<JsonField> _simulation_fields = {
+    {"init_pos", shape_numbers, 3, nullptr}, {"init_vel", shape_numbers, 3, nullptr}, {"mass", shape_numbers, 1, nullptr},
+    {"pinned", shape_bools, 1, nullptr}, {"vel", shape_numbers, 3, nullptr}, {"force", shape_numbers, 3, nullptr},
+    {"springs", shape_objects, 1, &_spring_fields} };
+static const vector<JsonField> _mesh_fields = {
+    {"frame", shape_object, 1, &_frame_fields}, {"pos", shape_numbers, 3, nullptr}, {"norm", shape_numbers, 3, nullptr},
+    {"texcoord", shape_numbers, 2, nullptr}, {"triangle", shape_numbers, 3, nullptr}, {"quad", shape_numbers, 4, nullptr},
+    {"point", shape_numbers, 1, nullptr}, {"line", shape_numbers, 2, nullptr}, {"spline", shape_numbers, 4, nullptr},
+    {"material", shape_object, 1, &_material_fields},
+    {"subdivision_catmullclark_level", shape_number, 1, nullptr}, {"subdivision_catmullclark_smooth", shape_bool, 1, nullptr},
+    {"subdivision_catmullclark_adaptive", shape_bool, 1, nullptr}, {"subdivision_catmullclark_adaptive_angle", shape_number, 1, nullptr},
+    {"subdivision_catmullclark_adaptive_area", shape_number, 1, nullptr}, {"subdivision_bezier_level", shape_number, 1, nullptr},
+    {"subdivision_bezier_uniform", shape_bool, 1, nullptr}, {"subdivision_bezier_tolerance", shape_number, 1, nullptr},
+    {"animation", shape_object, 1, &_frame_animation_fields}, {"skinning", shape_object, 1, &_skinning_fields},
+    {"simulation", shape_object, 1, &_simulation_fields},
+    {"json_mesh", shape_string, 1, nullptr}, {"bin_mesh", shape_string, 1, nullptr},
+    {"json_skinning", shape_string, 1, nullptr}, {"bin_skinning", shape_string, 1, nullptr}, {"bone_xforms_stream", shape_bool, 1, nullptr} };
+static const vector<JsonField> _surface_fields = {
+    {"frame", shape_object, 1, &_frame_fields}, {"radius", shape_number, 1, nullptr}, {"isquad", shape_bool, 1, nullptr},
+    {"material", shape_object, 1, &_material_fields}, {"subdivision_level", shape_number, 1, nullptr},
+    {"subdivision_smooth", shape_bool, 1, nullptr}, {"animation", shape_object, 1, &_frame_animation_fields} };
+static const vector<JsonField> _camera_fields = {
+    {"frame", shape_object, 1, &_frame_fields}, {"width", shape_number, 1, nullptr}, {"height", shape_number, 1, nullptr},
+    {"focus", shape_number, 1, nullptr}, {"dist", shape_number, 1, nullptr} };
+static const vector<JsonField> _lookat_camera_fields = {
+    {"from", shape_vector, 3, nullptr}, {"to", shape_vector, 3, nullptr}, {"up", shape_vector, 3, nullptr},
+    {"width", shape_number, 1, nullptr}, {"height", shape_number, 1, nullptr}, {"dist", shape_number, 1, nullptr} };
+static const vector<JsonField> _light_fields = {
+    {"frame", shape_object, 1, &_frame_fields}, {"intensity", shape_vector, 3, nullptr} };
+static const vector<JsonField> _scene_animation_fields = {
+    {"time", shape_number, 1, nullptr}, {"length", shape_number, 1, nullptr}, {"dt", shape_number, 1, nullptr},
+    {"simsteps", shape_number, 1, nullptr}, {"gravity", shape_vector, 3, nullptr}, {"bounce_dump", shape_vector, 2, nullptr} };
+static const vector<JsonField> _scene_fields = {
+    {"camera", shape_object, 1, &_camera_fields}, {"lookat_camera", shape_object, 1, &_lookat_camera_fields},
+    {"surfaces", shape_objects, 1, &_surface_fields}, {"json_meshes", shape_string, 1, nullptr},
+    {"meshes", shape_objects, 1, &_mesh_fields}, {"lights", shape_objects, 1, &_light_fields},
+    {"animation", shape_object, 1, &_scene_animation_fields}, {"image_width", shape_number, 1, nullptr},
+    {"image_height", shape_number, 1, nullptr}, {"image_samples", shape_number, 1, nullptr},
+    {"background", shape_vector, 3, nullptr}, {"ambient", shape_vector, 3, nullptr} };
+
+// whether a json value is an array of numbers
+static bool _json_is_numbers(const jsonvalue& json) {
+    if(json.is_numarray()) return true;
+    if(not json.is_array()) return false;
+    for(auto& value : json.as_array_ref()) if(not value.is_number()) return false;
+    return true;
+}
+
+static string _check_json_fields(const jsonvalue& json, const vector<JsonField>& fields);
+
+// first mismatch between a json value and the shape of a field (empty if none)
+static string _check_json_field(const jsonvalue& json, const JsonField& field) {
+    auto wrong = "wrong value for " + field.name;
+    switch(field.shape) {
+        case shape_bool: return (json.is_bool()) ? "" : wrong;
+        case shape_number: return (json.is_number()) ? "" : wrong;
+        case shape_string: return (json.is_string()) ? "" : wrong;
+        case shape_vector: return (_json_is_numbers(json) and json.array_size() == field.size) ? "" : wrong;
+        case shape_numbers: return (_json_is_numbers(json) and json.array_size() % field.size == 0) ? "" : wrong;
+        case shape_rows: {
+            if(not json.is_array()) return wrong;
+            for(auto& row : json.as_array_ref()) if(not _json_is_numbers(row) or row.array_size() % field.size != 0) return wrong;
+            return "";
+        }
+        case shape_bools: {
+            if(not json.is_array()) return wrong;
+            for(auto& value : json.as_array_ref()) if(not value.is_bool()) return wrong;
+            return "";
+        }
+        case shape_object: return (json.is_object()) ? _check_json_fields(json, *field.fields) : wrong;
+        case shape_objects: {
+            if(not json.is_array()) return wrong;
+            for(auto& value : json.as_array_ref()) {
+                if(not value.is_object()) return wrong;
+                auto msg = _check_json_fields(value, *field.fields);
+                if(not msg.empty()) return msg;
+            }
+            return "";
+        }
+        default: error("unknown shape"); return wrong;
+    }
+}
+
+// first mismatch between the values of a json object and the fields read from it (empty if none)
+static string _check_json_fields(const jsonvalue& json, const vector<JsonField>& fields) {
+    if(not json.is_object()) return "expected an object";
+    for(auto& field : fields) {
+        if(not json.object_contains(field.name)) continue;
+        auto msg = _check_json_field(json.object_element(field.name), field);
+        if(not msg.empty()) return msg;
+    }
+    return "";
+}
+
+// set msg to the problem found by a check, if any, and return whether there was none
+static bool _check_result(const string& problem, string& msg) {
+    if(not problem.empty()) msg = problem;
+    return problem.empty();
+}
+
+// textures of a material json, relative to dirname
+static bool _check_material_files(const jsonvalue& json, const string& dirname, string& msg) {
+    for(auto name : {"kd_txt", "ks_txt", "kr_txt", "norm_txt", "ke_txt"}) {
+        if(not json.object_contains(name)) continue;
+        auto filename = json.object_element(name).as_string();
+        if(not filename.empty() and not check_texture_file(json_filepath(dirname, filename), msg)) return false;
+    }
+    return true;
+}
+
+// files referenced by a mesh json, relative to dirname
+// (mesh files are only followed from the scene, as the loaders do)
+static bool _check_mesh_files(const jsonvalue& json, const string& dirname, bool mesh_files, string& msg) {
+    if(json.object_contains("material") and not _check_material_files(json.object_element("material"), dirname, msg)) return false;
+    if(mesh_files and json.object_contains("json_mesh")) {
+        auto filename = json_filepath(dirname, json.object_element("json_mesh").as_string());
+        auto mesh = jsonvalue();
+        if(not load_json(filename, mesh, msg)) return false;
+        if(not _check_result(_check_json_fields(mesh, _mesh_fields), msg) or not _check_mesh_files(mesh, json_dirname(filename), false, msg)) {
+            msg = filename + ": " + msg;
+            return false;
+        }
+    } else if(mesh_files and json.object_contains("bin_mesh")) {
+        if(not check_bin_mesh(json_filepath(dirname, json.object_element("bin_mesh").as_string()), msg)) return false;
+    }
+    if(json.object_contains("json_skinning")) {
+        auto filename = json_filepath(dirname, json.object_element("json_skinning").as_string());
+        auto skinning = jsonvalue();
+        if(not load_json(filename, skinning, msg)) return false;
+        if(not check_json_mesh_skinning(skinning, msg)) { msg = filename + ": " + msg; return false; }
+    } else if(json.object_contains("bin_skinning")) {
+        if(not check_bin_mesh_skinning(json_filepath(dirname, json.object_element("bin_skinning").as_string()), msg)) return false;
+    }
+    return true;
+}
+
+// meshes of a json_meshes file
+static bool _check_json_meshes(const jsonvalue& json, string& msg) {
+    return _check_result(_check_json_field(json, JsonField{"meshes", shape_objects, 1, &_mesh_fields}), msg);
+}
+
+bool check_json_scene(const jsonvalue& json, string& msg) {
+    return _check_result(_check_json_fields(json, _scene_fields), msg);
+}
+
+bool check_json_mesh(const jsonvalue& json, const string& dirname, string& msg) {
+    return _check_result(_check_json_fields(json, _mesh_fields), msg) and _check_mesh_files(json, dirname, true, msg);
+}
+
+bool check_json_mesh_skinning(const jsonvalue& json, string& msg) {
+    return _check_result(_check_json_fields(json, _skinning_fields), msg);
+}
+
+// section of a binary asset read by the loaders
+struct BinField {
+    string      name;           // section name
+    BinaryType  type;           // element type
+    int         components;     // components per element
+};
+
+// sections read by load_bin_mesh and load_bin_mesh_skinning (prefixed by the json path of their value)
+static const vector<BinField> _bin_skinning_fields = {
+    {"rest_pos", bin_float, 3}, {"rest_norm", bin_float, 3}, {"bone_ids", bin_int, 4}, {"bone_weights", bin_float, 4}, {"bone_xforms", bin_float, 16} };
+static const vector<BinField> _bin_simulation_fields = {
+    {"init_pos", bin_float, 3}, {"init_vel", bin_float, 3}, {"mass", bin_float, 1}, {"pinned", bin_byte, 1}, {"vel", bin_float, 3},
+    {"force", bin_float, 3}, {"springs.ids", bin_int, 2}, {"springs.restlength", bin_float, 1}, {"springs.ks", bin_float, 1}, {"springs.kd", bin_float, 1} };
+static const vector<BinField> _bin_mesh_fields = {
+    {"pos", bin_float, 3}, {"norm", bin_float, 3}, {"texcoord", bin_float, 2}, {"triangle", bin_int, 3}, {"quad", bin_int, 4},
+    {"point", bin_int, 1}, {"line", bin_int, 2}, {"spline", bin_int, 4}, {"meta", bin_text, 1} };
+
+// first section of a binary file whose type does not match the one read (empty if none)
+static string _check_bin_fields(const BinaryFile& bin, const string& prefix, const vector<BinField>& fields) {
+    for(auto& field : fields) {
+        auto sec = bin.section(prefix+field.name);
+        if(sec and (sec->type != field.type or (int)sec->components != field.components))
+            return tostring("wrong section type %s in %s", (prefix+field.name).c_str(), bin._filename.c_str());
+    }
+    return "";
+}
+
+bool check_bin_mesh(const string& filename, string& msg) {
+    if(not check_binary_file(filename, msg)) return false;
+    auto bin = BinaryFile(filename);
+    if(not _check_result(_check_bin_fields(bin, "", _bin_mesh_fields), msg)) return false;
+    if(not _check_result(_check_bin_fields(bin, "skinning.", _bin_skinning_fields), msg)) return false;
+    if(not _check_result(_check_bin_fields(bin, "simulation.", _bin_simulation_fields), msg)) return false;
+    // springs are checked as bin_read_mesh_simulation does
+    if(bin.has_section("simulation.springs.ids")) {
+        auto count = 0, nverts = 0;
+        auto ids = bin.view<int,2,vec2i>("simulation.springs.ids", count);
+        if(bin.has_section("pos")) bin.view<float,3,vec3f>("pos", nverts);
+        for(auto name : {"simulation.springs.restlength", "simulation.springs.ks", "simulation.springs.kd"}) {
+            if(bin.has_section(name) and (int)bin.section(name)->count == count) continue;
+            msg = tostring("corrupted binary file: spring sections of different size in %s", filename.c_str());
+            return false;
+        }
+        for(auto i : range(count)) {
+            if(ids[i].x >= 0 and ids[i].x < nverts and ids[i].y >= 0 and ids[i].y < nverts) continue;
+            msg = tostring("corrupted binary file: spring vertex out of range in %s", filename.c_str());
+            return false;
+        }
+    }
+    // the remaining values are stored as json
+    auto text = bin.read_text("meta");
+    if(text.empty()) return true;
+    if(not check_json(text, msg)) { msg = tostring("json reading error in the meta section of %s: %s", filename.c_str(), msg.c_str()); return false; }
+    auto meta = parse_json(text);
+    return _check_result(_check_json_fields(meta, _mesh_fields), msg) and _check_mesh_files(meta, json_dirname(filename), false, msg);
+}
+
+bool check_bin_mesh_skinning(const string& filename, string& msg) {
+    if(not check_binary_file(filename, msg)) return false;
+    return _check_result(_check_bin_fields(BinaryFile(filename), "", _bin_skinning_fields), msg);
+}
+
+// whether a file changed since it was last watched (or was not watched)
+static bool _file_changed(SceneWatch* watch, const string& filename) {
+    auto stamp = watch->stamps.find(filename);
+    return stamp == watch->stamps.end() or stamp->second != _file_stamp(filename);
+}
+
+// files referenced by a mesh json, relative to dirname
+static vector<string> _mesh_files(const jsonvalue& json, const string& dirname) {
+    auto files = vector<string>();
+    for(auto key : {"json_mesh", "bin_mesh", "json_skinning", "bin_skinning"}) {
+        if(json.object_contains(key)) files.push_back(json_filepath(dirname, json.object_element(key).as_string()));
+    }
+    return files;
+}
+
+// json of the scene meshes, either inline or loaded from json_meshes
+static const jsonvalue& _watched_meshes(SceneWatch* watch) {
+    if(watch->json.object_contains("meshes")) return watch->json.object_element("meshes");
+    return watch->meshes_json;
+}
+
+// record the stamps of the scene and of all the files it references
+static void _watch_files(Scene* scene, SceneWatch* watch) {
+    auto files = vector<string>({ watch->filename });
+    auto dirname = json_dirname(watch->filename), meshes_dirname = dirname;
+    if(watch->json.object_contains("json_meshes")) {
+        files.push_back(json_filepath(dirname, watch->json.object_element("json_meshes").as_string()));
+        if(not watch->json.object_contains("meshes")) meshes_dirname = json_dirname(files.back());
+    }
+    auto& meshes = _watched_meshes(watch);
+    if(meshes.is_array()) for(auto& value : meshes.as_array_ref()) for(auto& filename : _mesh_files(value, meshes_dirname)) files.push_back(filename);
+    for(auto texture : get_textures(scene)) files.push_back(texture_filename(texture));
+    watch->stamps.clear();
+    for(auto& filename : files) if(not filename.empty()) watch->stamps[filename] = _file_stamp(filename);
+}
+
+Scene* load_json_scene(const string& filename, SceneWatch* watch) {
+    watch->filename = filename;
+    watch->json = load_json(filename);
+    watch->meshes_json = jsonvalue();
+    if(not watch->json.object_contains("meshes") and watch->json.object_contains("json_meshes"))
+        watch->meshes_json = load_json(json_filepath(json_dirname(filename), watch->json.object_element("json_meshes").as_string()));
+    auto scene = json_parse_scene(watch->json, json_dirname(filename));
+    _watch_files(scene, watch);
     return scene;
 }
 
+// whether two json objects are equal, ignoring the values of key
+static bool _json_equal_except(const jsonvalue& a, const jsonvalue& b, const string& key) {
+    if(not a.is_object() or not b.is_object()) return false;
+    auto ai = a.as_object_ref().begin(), ae = a.as_object_ref().end();
+    auto bi = b.as_object_ref().begin(), be = b.as_object_ref().end();
+    while(true) {
+        if(ai != ae and ai->first == key) { ++ai; continue; }
+        if(bi != be and bi->first == key) { ++bi; continue; }
+        if(ai == ae or bi == be) return ai == ae and bi == be;
+        if(ai->first != bi->first or ai->second != bi->second) return false;
+        ++ai; ++bi;
+    }
+}
+
+// free a mesh replaced by a reload, with its material and animation data
+static void _delete_mesh(Mesh* mesh) {
+    if(mesh->_display_mesh and mesh->_display_mesh != mesh) delete mesh->_display_mesh;
+    delete mesh->_display_stencils;
+    _delete_material(mesh->mat);
+    delete mesh->skinning;
+    delete mesh->simulation;
+    delete mesh->animation;
+    delete mesh->collision;
+    delete mesh;
+}
+
+// whether two meshes have the same vertices, faces and springs, so that the simulation state of one fits the other
+static bool _same_topology(const Mesh* a, const Mesh* b) {
+    if(a->pos.size() != b->pos.size()) return false;
+    if(not (a->triangle == b->triangle and a->quad == b->quad and a->line == b->line and a->point == b->point and a->spline == b->spline)) return false;
+    if(not a->simulation or not b->simulation) return false;
+    auto& sa = a->simulation->springs;
+    auto& sb = b->simulation->springs;
+    if(sa.size() != sb.size()) return false;
+    for(auto i : range(sa.size())) if(not (sa[i].ids == sb[i].ids)) return false;
+    return true;
+}
+
+bool reload_json_scene(Scene* scene, SceneWatch* watch, SceneReload& reload) {
+    reload = SceneReload();
+    // polling only compares stamps; after a failed reload, files are read again only once they change again
+    auto stamps = watch->stamps;
+    for(auto& stamp : stamps) stamp.second = _file_stamp(stamp.first);
+    if(stamps == watch->stamps or stamps == watch->failed_stamps) return false;
+    
+    // all changed files are read and checked before anything is replaced, so that a malformed file
+    // (e.g. one saved half-way) is reported and leaves the scene and the watch as they were
+    auto msg = string();
+    auto failed = [&](){
+        message("scene not reloaded: %s\n", msg.c_str());
+        watch->failed_stamps = stamps;
+        return false;
+    };
+    
+    // scene and meshes json
+    auto json = jsonvalue();
+    if(not _file_changed(watch, watch->filename)) json = watch->json;
+    else if(not load_json(watch->filename, json, msg) or not check_json_scene(json, msg)) return failed();
+    auto meshes_json = jsonvalue();
+    auto dirname = json_dirname(watch->filename), meshes_dirname = dirname;
+    if(not json.object_contains("meshes") and json.object_contains("json_meshes")) {
+        auto filename = json_filepath(dirname, json.object_element("json_meshes").as_string());
+        if(not _file_changed(watch, filename)) meshes_json = watch->meshes_json;
+        else if(not load_json(filename, meshes_json, msg) or not _check_json_meshes(meshes_json, msg)) return failed();
+        meshes_dirname = json_dirname(filename);
+    }
+    auto& old_meshes = _watched_meshes(watch);
+    auto& new_meshes = (json.object_contains("meshes")) ? json.object_element("meshes") : meshes_json;
+    auto old_count = (old_meshes.is_array()) ? old_meshes.array_size() : 0;
+    auto new_count = (new_meshes.is_array()) ? new_meshes.array_size() : 0;
+    
+    // meshes: unchanged meshes are kept, meshes whose material alone changed get a new material,
+    // all others are parsed again together
+    auto meshes = vector<Mesh*>(new_count, nullptr);
+    auto parse = vector<int>(), materials = vector<int>();
+    for(auto i : range(new_count)) {
+        auto& value = new_meshes.array_element(i);
+        auto files_changed = false;
+        for(auto& filename : _mesh_files(value, meshes_dirname)) files_changed = files_changed or _file_changed(watch, filename);
+        if(i >= old_count or i >= (int)scene->meshes.size() or files_changed) { parse.push_back(i); continue; }
+        auto& old_value = old_meshes.array_element(i);
+        if(old_value == value) { meshes[i] = scene->meshes[i]; continue; }
+        if(_json_equal_except(old_value, value, "material")) { materials.push_back(i); continue; }
+        parse.push_back(i);
+    }
+    
+    // surfaces: unchanged surfaces are kept, all others are parsed again
+    auto empty = jsonvalue(jsonvalue::array());
+    auto& old_surfaces = (watch->json.object_contains("surfaces")) ? watch->json.object_element("surfaces") : empty;
+    auto& new_surfaces = (json.object_contains("surfaces")) ? json.object_element("surfaces") : empty;
+    auto surfaces = vector<Surface*>(new_surfaces.array_size(), nullptr);
+    auto parse_surfaces = vector<int>();
+    for(auto i : range(surfaces.size())) {
+        if(i < old_surfaces.array_size() and i < (int)scene->surfaces.size() and old_surfaces.array_element(i) == new_surfaces.array_element(i))
+            surfaces[i] = scene->surfaces[i];
+        else parse_surfaces.push_back(i);
+    }
+    
+    // files of the parts parsed again, and textures whose files changed
+    for(auto i : parse) if(not check_json_mesh(new_meshes.array_element(i), meshes_dirname, msg)) return failed();
+    for(auto i : materials) {
+        auto& value = new_meshes.array_element(i);
+        if(value.object_contains("material") and not _check_material_files(value.object_element("material"), meshes_dirname, msg)) return failed();
+    }
+    for(auto i : parse_surfaces) {
+        auto& value = new_surfaces.array_element(i);
+        if(value.object_contains("material") and not _check_material_files(value.object_element("material"), dirname, msg)) return failed();
+    }
+    for(auto texture : get_textures(scene)) {
+        auto filename = texture_filename(texture);
+        if(watch->stamps.count(filename) and _file_changed(watch, filename) and not check_texture_file(filename, msg)) return failed();
+    }
+    
+    // from here on, the scene is updated
+    for(auto i : materials) {
+        auto& value = new_meshes.array_element(i);
+        auto mesh = scene->meshes[i];
+        auto mat = (value.object_contains("material")) ? json_parse_material(value.object_element("material"), meshes_dirname) : new Material();
+        _delete_material(mesh->mat);
+        mesh->mat = mat;
+        if(mesh->_display_mesh) mesh->_display_mesh->mat = mat;
+        _material_textures(mat, reload.textures);
+        meshes[i] = mesh;
+    }
+    auto values = vector<const jsonvalue*>();
+    for(auto i : parse) values.push_back(&new_meshes.array_element(i));
+    auto parsed = json_parse_meshes(values, meshes_dirname);
+    for(auto p : range(parse.size())) {
+        auto i = parse[p];
+        auto mesh = parsed[p];
+        auto old = (i < (int)scene->meshes.size()) ? scene->meshes[i] : nullptr;
+        // simulations continue from their current state if they apply to the same particles and springs
+        if(old and _same_topology(old, mesh)) {
+            mesh->pos = old->pos;
+            mesh->simulation->vel = old->simulation->vel;
+            mesh->simulation->force = old->simulation->force;
+        } else reload.meshes_reset.push_back(mesh);
+        _material_textures(mesh->mat, reload.textures);
+        reload.meshes.push_back(mesh);
+        meshes[i] = mesh;
+    }
+    for(auto i : range(scene->meshes.size())) {
+        if(i >= new_count or meshes[i] != scene->meshes[i]) _delete_mesh(scene->meshes[i]);
+    }
+    scene->meshes = meshes;
+    
+    // surfaces
+    for(auto i : parse_surfaces) {
+        surfaces[i] = json_parse_surface(new_surfaces.array_element(i), dirname);
+        _material_textures(surfaces[i]->mat, reload.textures);
+        reload.surfaces.push_back(surfaces[i]);
+    }
+    for(auto i : range(scene->surfaces.size())) {
+        if(i < (int)surfaces.size() and surfaces[i] == scene->surfaces[i]) continue;
+        _delete_material(scene->surfaces[i]->mat);
+        delete scene->surfaces[i]->animation;
+        delete scene->surfaces[i];
+    }
+    scene->surfaces = surfaces;
+    
+    // lights are updated in place
+    auto& old_lights = (watch->json.object_contains("lights")) ? watch->json.object_element("lights") : empty;
+    auto& new_lights = (json.object_contains("lights")) ? json.object_element("lights") : empty;
+    if(old_lights != new_lights) {
+        for(auto i : range(new_lights.array_size())) {
+            auto light = json_parse_light(new_lights.array_element(i));
+            if(i < (int)scene->lights.size()) { *scene->lights[i] = *light; delete light; }
+            else scene->lights.push_back(light);
+        }
+        for(auto i : range(new_lights.array_size(), scene->lights.size())) delete scene->lights[i];
+        scene->lights.resize(new_lights.array_size());
+    }
+    
+    // camera, animation and rendering parameters (the animation time is kept)
+    for(auto key : {"camera", "lookat_camera"}) {
+        if(not json.object_contains(key)) continue;
+        if(watch->json.object_contains(key) and watch->json.object_element(key) == json.object_element(key)) continue;
+        auto camera = (string(key) == "camera") ? json_parse_camera(json.object_element(key)) : json_parse_lookatcamera(json.object_element(key));
+        *scene->camera = *camera;
+        delete camera;
+    }
+    if(json.object_contains("animation")) {
+        auto animation = json_parse_scene_animation(json.object_element("animation"));
+        animation->time = scene->animation->time;
+        *scene->animation = *animation;
+        delete animation;
+    }
+    json_set_optvalue(json, scene->background, "background");
+    json_set_optvalue(json, scene->ambient, "ambient");
+    
+    // textures whose files changed are decoded again in place
+    for(auto texture : get_textures(scene)) {
+        auto filename = texture_filename(texture);
+        if(watch->stamps.count(filename) and _file_changed(watch, filename)) {
+            reload_texture(texture);
+            reload.textures.push_back(texture);
+        }
+    }
+    std::sort(reload.textures.begin(), reload.textures.end());
+    reload.textures.erase(std::unique(reload.textures.begin(), reload.textures.end()), reload.textures.end());
+    
+    // watch the new state
+    watch->json = std::move(json);
+    watch->meshes_json = std::move(meshes_json);
+    watch->failed_stamps.clear();
+    _watch_files(scene, watch);
+    return true;
+}
+
 Scene* create_test_scene_sphere() {
     auto camera            = new Camera();
     camera->frame          = frame3f(z3f*2.5,x3f,y3f,z3f);
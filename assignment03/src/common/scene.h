@@ -5,9 +5,12 @@
 #include "json.h"
 #include "vmath.h"
 #include "image.h"
+#include "binary.h"
 
 // forward declarations
 struct BVHAccelerator;
+struct SubdivisionStencils;
+struct BoneXformStream;
 
 // blinn-phong material
 // textures are scaled by the respective coefficient and may be missing
@@ -18,11 +21,11 @@ struct Material {
     vec3f       kr = zero3f;            // reflection coefficient
     vec3f       ke = zero3f;            // emission coefficient
     
-    image3f*    kd_txt   = nullptr;     // diffuse texture
-    image3f*    ks_txt   = nullptr;     // specular texture
-    image3f*    kr_txt   = nullptr;     // reflection texture
-    image3f*    norm_txt = nullptr;     // normal texture
-    image3f*    ke_txt   = nullptr;     // emission texture
+    Texture*    kd_txt   = nullptr;     // diffuse texture
+    Texture*    ks_txt   = nullptr;     // specular texture
+    Texture*    kr_txt   = nullptr;     // reflection texture
+    Texture*    norm_txt = nullptr;     // normal texture
+    Texture*    ke_txt   = nullptr;     // emission texture
     
     bool        double_sided = false;   // double-sided material
     bool        microfacet   = false;   // use microfacet formulation
@@ -43,6 +46,15 @@ struct MeshSkinning {
     vector<vec4i>           bone_ids;      // skin bones
     vector<vec4f>           bone_weights;  // skin weights
     vector<vector<mat4f>>   bone_xforms;   // bone xforms (bone index is the first index)
+    
+    BoneXformStream*        bone_xforms_stream = nullptr;  // bone xforms paged in from disk (replaces bone_xforms)
+    
+    // skinnings own their stream, so they are not copied
+    MeshSkinning() = default;
+    MeshSkinning(const MeshSkinning&) = delete;
+    MeshSkinning& operator=(const MeshSkinning&) = delete;
+    // stop and delete the stream, if any
+    ~MeshSkinning();
 };
 
 // Mesh Simulation Data
@@ -89,14 +101,20 @@ struct Mesh {
     
     int  subdivision_catmullclark_level  = 0;       // catmullclark subdiv level
     bool subdivision_catmullclark_smooth = false;   // catmullclark subdiv smooth
+    bool  subdivision_catmullclark_adaptive       = false;  // catmullclark subdiv: only refine where needed
+    float subdivision_catmullclark_adaptive_angle = 10;     // adaptive: refine where normals deviate more (degrees)
+    float subdivision_catmullclark_adaptive_area  = 0.001f; // adaptive: refine faces covering more of the image
     int  subdivision_bezier_level        = 0;       // bezier subdiv level
     bool subdivision_bezier_uniform      = true;    // bezier subdiv: true=uniform, false=de casteljau
+    float subdivision_bezier_tolerance   = 0.001f;  // bezier subdiv: flatness tolerance for de casteljau
     
     FrameAnimation* animation  = nullptr;       // animation data
     MeshSkinning*   skinning   = nullptr;       // skinning data
     MeshSimulation* simulation = nullptr;       // simulation data
     MeshCollision*  collision  = nullptr;       // collision data
-
+    
+    Mesh*                   _display_mesh = nullptr;        // display mesh (subdivided from this control cage)
+    SubdivisionStencils*    _display_stencils = nullptr;    // stencils from this control cage to the display mesh
 };
 
 // surface made of either a sphere or a quad (as determined by
@@ -111,7 +129,7 @@ struct Surface {
 
     FrameAnimation* animation = nullptr;    // animation data
     
-    Mesh*       _display_mesh = nullptr;    // display mesh
+    Mesh*       _display_mesh = nullptr;    // display mesh (unit size and shared between surfaces)
     int         subdivision_level = 0;
     bool        subdivision_smooth = false;
 };
@@ -175,7 +193,7 @@ struct Scene {
 };
 
 // grab all scene textures
-vector<image3f*> get_textures(Scene* scene);
+vector<Texture*> get_textures(Scene* scene);
 
 // create a Camera at eye, pointing towards center with up vector up, and with specified image plane params
 Camera* lookat_camera(vec3f eye, vec3f center, vec3f up, float width, float height, float dist);
@@ -186,6 +204,71 @@ void set_view_turntable(Camera* camera, float rotate_phi, float rotate_theta, fl
 // load a scene from a json file
 Scene* load_json_scene(const string& filename);
 
+// scene file watched for changes: the json it was loaded from and the stamps
+// (modification time and size) of the scene and of every file it references
+struct SceneWatch {
+    string                                  filename;       // scene filename
+    jsonvalue                               json;           // scene json as last loaded
+    jsonvalue                               meshes_json;    // meshes loaded from json_meshes (if used)
+    map<string,pair<int64_t,int64_t>>       stamps;         // file stamps when last loaded
+    map<string,pair<int64_t,int64_t>>       failed_stamps;  // file stamps when a reload last failed
+};
+
+// parts of a scene replaced or updated by reload_json_scene
+struct SceneReload {
+    vector<Mesh*>       meshes;         // meshes parsed again (to subdivide and upload)
+    vector<Mesh*>       meshes_reset;   // meshes parsed again whose animation state could not be kept
+    vector<Surface*>    surfaces;       // surfaces parsed again (to subdivide)
+    vector<Texture*>    textures;       // textures decoded again or acquired by new materials (to upload)
+};
+
+// load a scene from a json file and watch its files for changes
+Scene* load_json_scene(const string& filename, SceneWatch* watch);
+
+// reload the parts of a scene whose json or referenced files changed since the last (re)load;
+// only changed meshes, materials, surfaces and lights are parsed again, and meshes whose
+// topology is unchanged keep their simulation state; returns whether anything changed
+bool reload_json_scene(Scene* scene, SceneWatch* watch, SceneReload& reload);
+
+// bone xforms of a frame, stored in the skinning or paged in from its stream
+// (a streamed frame stays valid until the next call for the same skinning)
+const vector<mat4f>& get_bone_xforms(MeshSkinning* skinning, int frame);
+
+// directory of a file (with its trailing separator), used to resolve the paths it references
+string json_dirname(const string& filename);
+// path of a file referenced by a json, relative to dirname unless absolute
+string json_filepath(const string& dirname, const string& filename);
+
+// parse meshes, skinnings and simulations from json values
+// (files and textures referenced by a mesh are relative to dirname)
+Mesh* json_parse_mesh(const jsonvalue& json, const string& dirname);
+MeshSkinning* json_parse_mesh_skinning(const jsonvalue& json);
+MeshSimulation* json_parse_mesh_simulation(const jsonvalue& json);
+
+// load a mesh or a mesh skinning from a json file, streaming large arrays directly into the mesh
+// (if meta is given, it is set to the remaining small values, e.g. material and subdivision settings)
+Mesh* load_json_mesh(const string& filename, jsonvalue* meta = nullptr);
+MeshSkinning* load_json_mesh_skinning(const string& filename);
+
+// load a mesh or a mesh skinning from a binary asset file (see binary.h)
+Mesh* load_bin_mesh(const string& filename);
+// (with stream_bone_xforms, bone xforms are paged in on demand instead, see get_bone_xforms)
+MeshSkinning* load_bin_mesh_skinning(const string& filename, bool stream_bone_xforms = false);
+// save a mesh or a mesh skinning to a binary asset file; meta holds the values stored as json
+void save_bin_mesh(const string& filename, const Mesh* mesh, const jsonvalue& meta);
+void save_bin_mesh_skinning(const string& filename, const MeshSkinning* skinning);
+
+// check json values and asset files against the values read by the parsers and loaders, without
+// stopping on errors, so that malformed files can be reported and skipped instead; each returns
+// whether the check passed, otherwise msg describes the first problem found
+// (files referenced by meshes are checked too, with textures relative to dirname; those
+// referenced by a scene are not, since each mesh may be checked when it is loaded)
+bool check_json_scene(const jsonvalue& json, string& msg);
+bool check_json_mesh(const jsonvalue& json, const string& dirname, string& msg);
+bool check_json_mesh_skinning(const jsonvalue& json, string& msg);
+bool check_bin_mesh(const string& filename, string& msg);
+bool check_bin_mesh_skinning(const string& filename, string& msg);
+
 // create test scenes that do not need to be loaded from a file
 Scene* create_test_scene(int scene_type);
 
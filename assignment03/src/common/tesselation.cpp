@@ -1,4 +1,5 @@
 #include "tesselation.h"
+#include "binary.h"
 
 // make normals for each face - duplicates all vertex data
 void facet_normals(Mesh* mesh) {
@@ -88,192 +89,792 @@ void smooth_tangents(Mesh* polyline) {
     for (auto& t : polyline->norm) t = normalize(t);
 }
 
+// split quads into two triangles along the diagonal (y,w), as GL_QUADS are drawn
+vector<vec3i> triangulate_quads(const vector<vec4i>& quad) {
+    auto triangle = vector<vec3i>();
+    triangle.reserve(quad.size()*2);
+    for(auto f : quad) {
+        triangle.push_back({f.x,f.y,f.w});
+        triangle.push_back({f.y,f.z,f.w});
+    }
+    return triangle;
+}
+
+// tipsify [Sander et al. 2007]: triangles are emitted in fans around a current vertex; the next
+// one is the neighbor still in the cache with the most triangles left, or the most recently
+// used vertex with triangles left when none is (a dead end)
+vector<vec3i> optimize_triangle_order(const vector<vec3i>& triangle, int cache_size) {
+    auto nverts = 0;
+    for(auto f : triangle) nverts = max(nverts, max(f.x, max(f.y, f.z))+1);
+    // vertex to triangle adjacency, as compressed rows
+    auto offset = vector<int>(nverts+1, 0);
+    for(auto f : triangle) for(auto i : range(3)) offset[f[i]+1] ++;
+    for(auto v : range(nverts)) offset[v+1] += offset[v];
+    auto adjacency = vector<int>(offset.back());
+    auto fill = vector<int>(offset.begin(), offset.end()-1);
+    for(auto t : range((int)triangle.size())) for(auto i : range(3)) adjacency[fill[triangle[t][i]]++] = t;
+    // live triangles per vertex, cache time stamps and emitted triangles
+    auto live = vector<int>(nverts);
+    for(auto v : range(nverts)) live[v] = offset[v+1] - offset[v];
+    auto stamp = vector<int>(nverts, 0);
+    auto emitted = vector<bool>(triangle.size(), false);
+    auto dead_end = vector<int>();
+    auto candidates = vector<int>();
+    auto ordered = vector<vec3i>();
+    ordered.reserve(triangle.size());
+    auto time = cache_size+1, cursor = 0, fan = (nverts) ? 0 : -1;
+    while(fan >= 0) {
+        // emit the triangles around the fanning vertex
+        candidates.clear();
+        for(auto a : range(offset[fan], offset[fan+1])) {
+            auto t = adjacency[a];
+            if(emitted[t]) continue;
+            for(auto i : range(3)) {
+                auto v = triangle[t][i];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v] --;
+                if(time - stamp[v] > cache_size) stamp[v] = time++;
+            }
+            emitted[t] = true;
+            ordered.push_back(triangle[t]);
+        }
+        // pick the candidate that stays in the cache while its fan is emitted and is the oldest
+        fan = -1;
+        auto best = -1;
+        for(auto v : candidates) {
+            if(live[v] <= 0) continue;
+            auto priority = (time - stamp[v] + 2*live[v] <= cache_size) ? time - stamp[v] : 0;
+            if(priority > best) { best = priority; fan = v; }
+        }
+        // otherwise restart from the most recent vertex with triangles left, then in input order
+        while(fan < 0 and not dead_end.empty()) {
+            auto v = dead_end.back();
+            dead_end.pop_back();
+            if(live[v] > 0) fan = v;
+        }
+        while(fan < 0 and cursor < nverts) {
+            if(live[cursor] > 0) fan = cursor;
+            else cursor ++;
+        }
+    }
+    return ordered;
+}
+
+// grow a buffer if needed (never shrinks, so buffers are reused across levels)
+template<typename T>
+static void _grow(vector<T>& v, size_t n) { if(v.size() < n) v.resize(n); }
+
+// edge indexing without maps: for each vertex, the unique neighbors with a larger index are
+// stored in compressed rows; edge ids are assigned in vertex order
+struct _EdgeIndex {
+    vector<int>     offset;     // start of the neighbors of each vertex
+    vector<int>     count;      // number of unique neighbors of each vertex
+    vector<int>     base;       // edge id of the first edge of each vertex
+    vector<int>     adj;        // neighbors
+    int             nedges = 0; // number of edges
+    
+    // build the index for a collection of triangles and quads
+    void build(int nv, const vec3i* triangle, int nt, const vec4i* quad, int nq) {
+        _grow(offset, nv+1); _grow(count, nv); _grow(base, nv); _grow(adj, nt*3+nq*4);
+        for(auto i : range(nv+1)) offset[i] = 0;
+        for(auto fi : range(nt)) for(auto i : range(3)) offset[min(triangle[fi][i],triangle[fi][(i+1)%3])+1] ++;
+        for(auto fi : range(nq)) for(auto i : range(4)) offset[min(quad[fi][i],quad[fi][(i+1)%4])+1] ++;
+        for(auto i : range(nv)) { offset[i+1] += offset[i]; count[i] = 0; }
+        for(auto fi : range(nt)) for(auto i : range(3)) _add(triangle[fi][i],triangle[fi][(i+1)%3]);
+        for(auto fi : range(nq)) for(auto i : range(4)) _add(quad[fi][i],quad[fi][(i+1)%4]);
+        nedges = 0;
+        for(auto i : range(nv)) { base[i] = nedges; nedges += count[i]; }
+    }
+    
+    // internal function to add an edge (skipping duplicates)
+    void _add(int i, int j) {
+        if(i > j) std::swap(i,j);
+        for(auto k : range(offset[i],offset[i]+count[i])) if(adj[k] == j) return;
+        adj[offset[i]+count[i]++] = j;
+    }
+    
+    // get an edge from two vertices
+    int edge_index(int i, int j) const {
+        if(i > j) std::swap(i,j);
+        for(auto k : range(count[i])) if(adj[offset[i]+k] == j) return base[i]+k;
+        error("non existing edge");
+        return -1;
+    }
+};
+
 // apply Catmull-Clark mesh subdivision
+// output sizes are computed up front and each level is written into one of two
+// preallocated ping-pong buffers, so no mesh copies or per-level allocations are made
 // does not subdivide texcoord
 void subdivide_catmullclark(Mesh* subdiv) {
     // skip is needed
     if(not subdiv->subdivision_catmullclark_level) return;
-    // allocate a working Mesh copied from the subdiv
-    auto mesh = new Mesh(*subdiv);
+    auto levels = subdiv->subdivision_catmullclark_level;
+    // ping-pong buffers, starting from the mesh arrays
+    vector<vec3f> pos[2]; vector<vec4i> quad[2];
+    std::swap(pos[0], subdiv->pos);
+    std::swap(quad[0], subdiv->quad);
+    auto& triangle = subdiv->triangle;
+    // edge count of the control mesh
+    auto edges = _EdgeIndex();
+    edges.build(pos[0].size(), triangle.data(), triangle.size(), quad[0].data(), quad[0].size());
+    // compute sizes at every level: after the first level all faces are quads and
+    // each edge is split in two, while each face adds an edge per side
+    auto nv0 = (int)pos[0].size(), nq0 = (int)quad[0].size();
+    auto nv = nv0, ne = edges.nedges, nt = (int)triangle.size(), nq = nq0;
+    auto max_nv = nv, max_nq = nq, max_half_edges = nt*3+nq*4, max_edge_nv = nv;
+    for(auto l : range(levels)) {
+        max_edge_nv = max(max_edge_nv,nv);
+        auto nnv = nv + ne + nt + nq, nnq = nt*3 + nq*4, nne = ne*2 + nt*3 + nq*4;
+        nv = nnv; nq = nnq; ne = nne; nt = 0;
+        max_nv = max(max_nv,nv); max_nq = max(max_nq,nq);
+        if(l < levels-1) max_half_edges = max(max_half_edges,nq*4);
+    }
+    // allocate all buffers once
+    for(auto i : range(2)) { _grow(pos[i], max_nv); _grow(quad[i], max_nq); }
+    auto avg_pos = vector<vec3f>(max_nv);
+    auto avg_count = vector<int>(max_nv);
+    _grow(edges.offset, max_edge_nv+1); _grow(edges.count, max_edge_nv); _grow(edges.base, max_edge_nv);
+    _grow(edges.adj, max_half_edges);
+    // current sizes
+    nv = nv0; nt = (int)triangle.size(); nq = nq0;
+    auto cur = 0;
+    // foreach level
+    for(auto l : range(levels)) {
+        auto& cpos = pos[cur]; auto& cquad = quad[cur];
+        auto& npos = pos[1-cur]; auto& nquad = quad[1-cur];
+        if(l) edges.build(nv, nullptr, 0, cquad.data(), nq);
+        // linear subdivision - copy vertices, then add edge, triangle and quad centers
+        for(auto i : range(nv)) npos[i] = cpos[i];
+        auto evo = nv;
+        for(auto i : range(nv)) {
+            for(auto k : range(edges.count[i])) {
+                npos[evo+edges.base[i]+k] = (cpos[i]+cpos[edges.adj[edges.offset[i]+k]])/2;
+            }
+        }
+        auto tvo = evo + edges.nedges;
+        for(auto fi : range(nt)) { auto f = triangle[fi]; npos[tvo+fi] = (cpos[f.x]+cpos[f.y]+cpos[f.z])/3; }
+        auto qvo = tvo + nt;
+        for(auto fi : range(nq)) { auto f = cquad[fi]; npos[qvo+fi] = (cpos[f.x]+cpos[f.y]+cpos[f.z]+cpos[f.w])/4; }
+        auto nnv = qvo + nq;
+        // subdivision pass
+        auto nnq = 0;
+        for(auto fi : range(nt)) {
+            auto f = triangle[fi];
+            for(auto i : range(3))
+                nquad[nnq++] = {f[i],evo+edges.edge_index(f[i],f[(i+1)%3]),
+                    tvo+fi,evo+edges.edge_index(f[i],f[(i+2)%3])};
+        }
+        for(auto fi : range(nq)) {
+            auto f = cquad[fi];
+            for(auto i : range(4))
+                nquad[nnq++] = {f[i],evo+edges.edge_index(f[i],f[(i+1)%4]),
+                    qvo+fi,evo+edges.edge_index(f[i],f[(i+3)%4])};
+        }
+        // averaging pass
+        for(auto i : range(nnv)) { avg_pos[i] = zero3f; avg_count[i] = 0; }
+        for(auto fi : range(nnq)) {
+            auto f = nquad[fi];
+            auto fc = (npos[f.x]+npos[f.y]+npos[f.z]+npos[f.w])/4;
+            for(auto i : range(4)) { avg_pos[f[i]] += fc; avg_count[f[i]] += 1; }
+        }
+        // correction pass: p = p + (avg_p - p) * (4/avg_count)
+        for(auto i : range(nnv)) npos[i] = npos[i] + (avg_pos[i] / avg_count[i] - npos[i]) * (4.0f / avg_count[i]);
+        // swap buffers; only quads are left after the first level
+        cur = 1-cur; nv = nnv; nq = nnq; nt = 0;
+    }
+    // move the final buffers back into the mesh
+    pos[cur].resize(nv); quad[cur].resize(nq);
+    std::swap(subdiv->pos, pos[cur]);
+    std::swap(subdiv->quad, quad[cur]);
+    subdiv->triangle.clear();
+    // clear subdivision
+    subdiv->subdivision_catmullclark_level = 0;
+    // according to smooth, either smooth_normals or facet_normals
+    if(subdiv->subdivision_catmullclark_smooth) smooth_normals(subdiv);
+    else facet_normals(subdiv);
+}
+
+// fraction of the camera image covered by a polygon (zero if any vertex is behind the camera)
+static float _screen_area(Camera* camera, const frame3f& frame, const vector<vec3f>& pos, const vec4i& f, int n) {
+    vec2f uv[4];
+    for(auto i : range(n)) {
+        auto p = transform_point_inverse(camera->frame, transform_point(frame, pos[f[i]]));
+        if(p.z >= 0) return 0;
+        uv[i] = vec2f(p.x / (-p.z * camera->width / camera->dist), p.y / (-p.z * camera->height / camera->dist));
+    }
+    auto area = 0.0f;
+    for(auto i : range(n)) area += uv[i].x * uv[(i+1)%n].y - uv[(i+1)%n].x * uv[i].y;
+    return fabs(area) / 2;
+}
+
+// apply adaptive Catmull-Clark mesh subdivision
+// only marked faces are split into quads; unmarked faces sharing a split edge are fanned
+// into triangles around their center, so the result is always conforming (crack-free);
+// all vertices are placed as uniform subdivision would place them, so refined regions
+// match subdivide_catmullclark and coarser regions lie on the same surface
+// does not subdivide texcoord
+void subdivide_catmullclark_adaptive(Mesh* subdiv, Camera* camera) {
+    // skip is needed
+    if(not subdiv->subdivision_catmullclark_level) return;
+    auto triangle = subdiv->triangle;
+    auto quad = subdiv->quad;
+    auto& pos = subdiv->pos;
+    auto cos_angle = cos(radians(subdiv->subdivision_catmullclark_adaptive_angle));
+    // extraordinary vertices of the control cage (old vertices keep their index across levels)
+    auto extraordinary = vector<bool>(pos.size(),false);
+    {
+        auto edge_map = EdgeMap(triangle,quad);
+        auto valence = vector<int>(pos.size(),0);
+        auto boundary = vector<bool>(pos.size(),false);
+        auto edge_faces = vector<int>(edge_map.edges().size(),0);
+        for(auto f : triangle) for(auto i : range(3)) edge_faces[edge_map.edge_index({f[i],f[(i+1)%3]})] ++;
+        for(auto f : quad) for(auto i : range(4)) edge_faces[edge_map.edge_index({f[i],f[(i+1)%4]})] ++;
+        for(auto ei : range(edge_map.edges().size())) {
+            auto e = edge_map.edges()[ei];
+            valence[e.x] ++; valence[e.y] ++;
+            if(edge_faces[ei] == 1) boundary[e.x] = boundary[e.y] = true;
+        }
+        for(auto i : range(pos.size())) extraordinary[i] = (boundary[i]) ? valence[i] > 3 : valence[i] != 4;
+    }
     // foreach level
     for(auto l : range(subdiv->subdivision_catmullclark_level)) {
-        // make empty pos and quad arrays
-        auto pos = vector<vec3f>();
-        auto quad = vector<vec4i>();
-        // create edge_map from current mesh
-        auto edge_map = EdgeMap(mesh->triangle,mesh->quad);
-        // linear subdivision - create vertices
-        // copy all vertices from the current mesh
-        for(auto p : mesh->pos) pos.push_back(p);
-        // add vertices in the middle of each edge (use EdgeMap)
-        for(auto e : edge_map.edges()) pos.push_back((mesh->pos[e.x]+mesh->pos[e.y])/2);
-        // add vertices in the middle of each triangle
-        for(auto f : mesh->triangle) pos.push_back((mesh->pos[f.x]+mesh->pos[f.y]+mesh->pos[f.z])/3);
-        // add vertices in the middle of each quad
-        for(auto f : mesh->quad) pos.push_back((mesh->pos[f.x]+mesh->pos[f.y]+mesh->pos[f.z]+mesh->pos[f.w])/4);
-        // subdivision pass --------------------------------
-        // compute an offset for the edge vertices
-        auto evo = (int)mesh->pos.size();
-        // compute an offset for the triangle vertices
+        // faces as quads, with w < 0 for triangles
+        auto faces = vector<vec4i>();
+        for(auto f : triangle) faces.push_back({f.x,f.y,f.z,-1});
+        for(auto f : quad) faces.push_back(f);
+        auto edge_map = EdgeMap(triangle,quad);
+        auto nedges = (int)edge_map.edges().size();
+        // face and vertex normals to estimate curvature
+        auto face_norm = vector<vec3f>(faces.size());
+        auto vert_norm = vector<vec3f>(pos.size(),zero3f);
+        for(auto fi : range(faces.size())) {
+            auto f = faces[fi];
+            face_norm[fi] = (f.w < 0) ? normalize(cross(pos[f.y]-pos[f.x], pos[f.z]-pos[f.x])) :
+                normalize(normalize(cross(pos[f.y]-pos[f.x], pos[f.z]-pos[f.x])) +
+                          normalize(cross(pos[f.z]-pos[f.x], pos[f.w]-pos[f.x])));
+            for(auto i : range((f.w < 0) ? 3 : 4)) vert_norm[f[i]] += face_norm[fi];
+        }
+        for(auto& n : vert_norm) n = normalize(n);
+        // mark faces to refine
+        auto refine = vector<bool>(faces.size(),false);
+        for(auto fi : range(faces.size())) {
+            auto f = faces[fi];
+            auto n = (f.w < 0) ? 3 : 4;
+            for(auto i : range(n)) {
+                if(f[i] < (int)extraordinary.size() and extraordinary[f[i]]) refine[fi] = true;
+                if(dot(face_norm[fi],vert_norm[f[i]]) < cos_angle) refine[fi] = true;
+            }
+            if(camera and _screen_area(camera, subdiv->frame, pos, f, n) > subdiv->subdivision_catmullclark_adaptive_area) refine[fi] = true;
+        }
+        // mark split edges; faces with all edges split are refined too
+        auto split = vector<bool>(nedges,false);
+        for(auto fi : range(faces.size())) {
+            if(not refine[fi]) continue;
+            auto f = faces[fi]; auto n = (f.w < 0) ? 3 : 4;
+            for(auto i : range(n)) split[edge_map.edge_index({f[i],f[(i+1)%n]})] = true;
+        }
+        auto nsplit = vector<int>(faces.size(),0);
+        for(auto fi : range(faces.size())) {
+            auto f = faces[fi]; auto n = (f.w < 0) ? 3 : 4;
+            for(auto i : range(n)) if(split[edge_map.edge_index({f[i],f[(i+1)%n]})]) nsplit[fi] ++;
+            if(nsplit[fi] == n) refine[fi] = true;
+        }
+        // Catmull-Clark positions of every vertex, edge point and face point, as uniform subdivision
+        // computes them: each face is split into quads around its center, then each point is moved by
+        // averaging the centers of the quads around it and correcting (same passes and order as
+        // subdivide_catmullclark); points are created only where needed, but all of them, including
+        // the vertices of unrefined and transition faces, take these positions, so refined regions
+        // match uniform subdivision and the rest of the mesh samples the same surface
+        auto nverts = (int)pos.size();
+        auto edge_pos = vector<vec3f>(nedges);
+        for(auto ei : range(nedges)) { auto e = edge_map.edges()[ei]; edge_pos[ei] = (pos[e.x]+pos[e.y])/2; }
+        auto face_pos = vector<vec3f>(faces.size());
+        for(auto fi : range(faces.size())) {
+            auto f = faces[fi]; auto n = (f.w < 0) ? 3 : 4;
+            auto c = zero3f;
+            for(auto i : range(n)) c += pos[f[i]];
+            face_pos[fi] = c / n;
+        }
+        auto vert_avg = vector<vec3f>(nverts,zero3f); auto vert_count = vector<int>(nverts,0);
+        auto edge_avg = vector<vec3f>(nedges,zero3f); auto edge_count = vector<int>(nedges,0);
+        auto face_avg = vector<vec3f>(faces.size(),zero3f);
+        for(auto fi : range(faces.size())) {
+            auto f = faces[fi]; auto n = (f.w < 0) ? 3 : 4;
+            for(auto i : range(n)) {
+                auto e0 = edge_map.edge_index({f[i],f[(i+1)%n]}), e1 = edge_map.edge_index({f[i],f[(i+n-1)%n]});
+                auto fc = (pos[f[i]]+edge_pos[e0]+face_pos[fi]+edge_pos[e1])/4;
+                vert_avg[f[i]] += fc; vert_count[f[i]] += 1;
+                edge_avg[e0] += fc; edge_count[e0] += 1;
+                face_avg[fi] += fc;
+                edge_avg[e1] += fc; edge_count[e1] += 1;
+            }
+        }
+        auto correct = [](const vec3f& p, const vec3f& avg, int count){ return p + (avg / count - p) * (4.0f / count); };
+        // vertices are kept, with their new positions
+        auto npos = vector<vec3f>(nverts);
+        for(auto i : range(nverts)) npos[i] = (vert_count[i]) ? correct(pos[i], vert_avg[i], vert_count[i]) : pos[i];
+        // create vertices at split edges and at refined or transition face centers
+        auto edge_vert = vector<int>(nedges,-1);
+        for(auto ei : range(nedges)) {
+            if(not split[ei]) continue;
+            edge_vert[ei] = npos.size();
+            npos.push_back(correct(edge_pos[ei], edge_avg[ei], edge_count[ei]));
+        }
+        auto face_vert = vector<int>(faces.size(),-1);
+        for(auto fi : range(faces.size())) {
+            if(not refine[fi] and not nsplit[fi]) continue;
+            face_vert[fi] = npos.size();
+            npos.push_back(correct(face_pos[fi], face_avg[fi], (faces[fi].w < 0) ? 3 : 4));
+        }
+        // subdivision pass - refined faces become quads, transition faces a triangle fan
+        auto ntriangle = vector<vec3i>();
+        auto nquad = vector<vec4i>();
+        for(auto fi : range(faces.size())) {
+            auto f = faces[fi]; auto n = (f.w < 0) ? 3 : 4;
+            auto ev = [&](int i, int j){ return edge_vert[edge_map.edge_index({f[i],f[j]})]; };
+            if(refine[fi]) {
+                for(auto i : range(n)) nquad.push_back({f[i],ev(i,(i+1)%n),face_vert[fi],ev(i,(i+n-1)%n)});
+            } else if(nsplit[fi]) {
+                auto ring = vector<int>();
+                for(auto i : range(n)) {
+                    ring.push_back(f[i]);
+                    if(ev(i,(i+1)%n) >= 0) ring.push_back(ev(i,(i+1)%n));
+                }
+                for(auto i : range(ring.size())) ntriangle.push_back({ring[i],ring[(i+1)%ring.size()],face_vert[fi]});
+            } else if(n == 3) ntriangle.push_back({f.x,f.y,f.z});
+            else nquad.push_back(f);
+        }
+        // set new arrays back
+        pos = npos;
+        triangle = ntriangle;
+        quad = nquad;
+    }
+    // set topology back and clear subdivision
+    subdiv->triangle = triangle;
+    subdiv->quad = quad;
+    subdiv->subdivision_catmullclark_level = 0;
+    // according to smooth, either smooth_normals or facet_normals
+    if(subdiv->subdivision_catmullclark_smooth) smooth_normals(subdiv);
+    else facet_normals(subdiv);
+}
+
+// sparse weighted sum of control vertices used while building stencils
+typedef vector<pair<int,float>> _stencil;
+
+// accumulate a scaled stencil (a += b * w)
+static void _stencil_add(_stencil& a, const _stencil& b, float w) {
+    for(auto& e : b) a.push_back({e.first, e.second * w});
+}
+
+// merge duplicated control vertices in a stencil
+static void _stencil_compact(_stencil& a) {
+    std::sort(a.begin(), a.end());
+    auto n = 0;
+    for(auto i : range(a.size())) {
+        if(n and a[n-1].first == a[i].first) a[n-1].second += a[i].second;
+        else a[n++] = a[i];
+    }
+    a.resize(n);
+}
+
+// apply the same catmull-clark passes of subdivide_catmullclark to stencils instead of positions
+static vector<_stencil> _catmullclark_stencils(Mesh* cage, vector<vec4i>& quad) {
+    // start from the identity stencils
+    auto st = vector<_stencil>(cage->pos.size());
+    for(auto i : range(cage->pos.size())) st[i] = { {i,1.0f} };
+    auto triangle = cage->triangle;
+    quad = cage->quad;
+    // foreach level
+    for(auto l : range(cage->subdivision_catmullclark_level)) {
+        auto edge_map = EdgeMap(triangle,quad);
+        // linear subdivision - old vertices, edge, triangle and quad centers
+        auto nst = st;
+        for(auto e : edge_map.edges()) {
+            auto s = _stencil();
+            _stencil_add(s, st[e.x], 1/2.0f); _stencil_add(s, st[e.y], 1/2.0f);
+            _stencil_compact(s); nst.push_back(s);
+        }
+        for(auto f : triangle) {
+            auto s = _stencil();
+            for(auto i : range(3)) _stencil_add(s, st[f[i]], 1/3.0f);
+            _stencil_compact(s); nst.push_back(s);
+        }
+        for(auto f : quad) {
+            auto s = _stencil();
+            for(auto i : range(4)) _stencil_add(s, st[f[i]], 1/4.0f);
+            _stencil_compact(s); nst.push_back(s);
+        }
+        // subdivision pass
+        auto evo = (int)st.size();
         auto tvo = evo + (int)edge_map.edges().size();
-        // compute an offset for the quad vertices
-        auto qvo = tvo + (int)mesh->triangle.size();
-        // foreach triangle
-        for(auto fi : range(mesh->triangle.size())) {
-            auto f = mesh->triangle[fi];
-            // add three quads to the new quad array
+        auto qvo = tvo + (int)triangle.size();
+        auto nquad = vector<vec4i>();
+        for(auto fi : range(triangle.size())) {
+            auto f = triangle[fi];
             for(auto i : range(3))
-                quad.push_back({f[i],evo+edge_map.edge_index({f[i],f[(i+1)%3]}),
+                nquad.push_back({f[i],evo+edge_map.edge_index({f[i],f[(i+1)%3]}),
                     tvo+fi,evo+edge_map.edge_index({f[i],f[(i+2)%3]})});
         }
-        // foreach quad
-        for(auto fi : range(mesh->quad.size())) {
-            auto f = mesh->quad[fi];
-            // add four quads to the new quad array
+        for(auto fi : range(quad.size())) {
+            auto f = quad[fi];
             for(auto i : range(4))
-                quad.push_back({f[i],evo+edge_map.edge_index({f[i],f[(i+1)%4]}),
+                nquad.push_back({f[i],evo+edge_map.edge_index({f[i],f[(i+1)%4]}),
                     qvo+fi,evo+edge_map.edge_index({f[i],f[(i+3)%4]})});
         }
-        // averaging pass ----------------------------------
-        // create arrays to compute pos averages (avg_pos, avg_count)
-        // arrays have the same length as the new pos array, and are init to zero
-        auto avg_pos = vector<vec3f>(pos.size(),zero3f);
-        auto avg_count = vector<int>(pos.size(),0);
-        // for each new quad
-        for(auto f : quad) {
-            // compute quad center using the new pos array
-            auto fc = (pos[f.x]+pos[f.y]+pos[f.z]+pos[f.w])/4;
-            // foreach vertex index in the quad
-            for(auto i : range(4)) {
-                // accumulate face center to the avg_pos and add 1 to avg_count
-                avg_pos[f[i]] += fc;
-                avg_count[f[i]] += 1;
-            }
+        // averaging pass
+        auto avg_st = vector<_stencil>(nst.size());
+        auto avg_count = vector<int>(nst.size(),0);
+        for(auto f : nquad) {
+            auto fc = _stencil();
+            for(auto i : range(4)) _stencil_add(fc, nst[f[i]], 1/4.0f);
+            _stencil_compact(fc);
+            for(auto i : range(4)) { _stencil_add(avg_st[f[i]], fc, 1); avg_count[f[i]] += 1; }
         }
-        // normalize avg_pos with its count avg_count
-        for(auto i : range(pos.size())) avg_pos[i] /= avg_count[i];
-        // correction pass ----------------------------------
-        // foreach pos, compute correction p = p + (avg_p - p) * (4/avg_count)
-        for(auto i : range(pos.size())) pos[i] = pos[i] + (avg_pos[i] - pos[i]) * (4.0f / avg_count[i]);
-        // set new arrays pos, quad back into the working mesh; clear triangle array
-        mesh->pos = pos;
-        mesh->triangle = vector<vec3i>();
-        mesh->quad = quad;
+        // correction pass: p = p + (avg_p - p) * (4/avg_count)
+        for(auto i : range(nst.size())) {
+            auto c = (float)avg_count[i];
+            auto s = _stencil();
+            _stencil_add(s, nst[i], 1 - 4 / c);
+            _stencil_add(s, avg_st[i], 4 / (c*c));
+            _stencil_compact(s);
+            nst[i] = s;
+        }
+        st = nst;
+        triangle.clear();
+        quad = nquad;
+    }
+    return st;
+}
+
+// minimum vertices or faces per thread when updating display meshes: starting a thread costs
+// about as much as updating a thousand vertices, so small meshes are updated on the calling
+// thread and larger ones only split in chunks that take well over the thread start
+static const int _update_min_chunk = 16384;
+
+// evaluate stencils on cage positions and recompute display normals, in parallel
+static void _update_display_mesh(Mesh* cage) {
+    auto st = cage->_display_stencils;
+    auto display = cage->_display_mesh;
+    display->frame = cage->frame;
+    parallel_for(st->size(), [&](int start, int end){
+        for(auto i : range(start,end)) {
+            auto p = zero3f;
+            for(auto k : range(st->offset[i],st->offset[i+1])) p += cage->pos[st->ids[k]] * st->weights[k];
+            display->pos[i] = p;
+        }
+    }, _update_min_chunk);
+    // face normals, then vertex normals from the cached vertex-face adjacency
+    // (for faceted meshes each vertex has only one face, giving the face normal)
+    auto face_norm = vector<vec3f>(display->quad.size());
+    parallel_for(display->quad.size(), [&](int start, int end){
+        for(auto i : range(start,end)) {
+            auto f = display->quad[i];
+            auto& pos = display->pos;
+            face_norm[i] = normalize(normalize(cross(pos[f.y]-pos[f.x], pos[f.z]-pos[f.x])) +
+                                     normalize(cross(pos[f.z]-pos[f.x], pos[f.w]-pos[f.x])));
+        }
+    }, _update_min_chunk);
+    parallel_for(st->size(), [&](int start, int end){
+        for(auto i : range(start,end)) {
+            auto n = zero3f;
+            for(auto k : range(st->vert_face_offset[i],st->vert_face_offset[i+1])) n += face_norm[st->vert_faces[k]];
+            display->norm[i] = normalize(n);
+        }
+    }, _update_min_chunk);
+}
+
+// build the display mesh of a deforming cage
+// the cage keeps its topology and is animated; the display mesh is re-evaluated from cached stencils
+void subdivide_catmullclark_stencils(Mesh* cage) {
+    // skip is needed
+    if(not cage->subdivision_catmullclark_level) return;
+    // compute stencils and refined topology
+    auto quad = vector<vec4i>();
+    auto st = _catmullclark_stencils(cage, quad);
+    // faceted meshes get one stencil per face corner so that vertices are not shared
+    if(not cage->subdivision_catmullclark_smooth) {
+        auto fst = vector<_stencil>();
+        for(auto fi : range(quad.size())) {
+            for(auto i : range(4)) fst.push_back(st[quad[fi][i]]);
+            quad[fi] = {fi*4,fi*4+1,fi*4+2,fi*4+3};
+        }
+        st = fst;
+    }
+    // pack stencils into compressed rows
+    auto stencils = new SubdivisionStencils();
+    stencils->cage_size = cage->pos.size();
+    stencils->offset.push_back(0);
+    for(auto& s : st) {
+        for(auto& e : s) { stencils->ids.push_back(e.first); stencils->weights.push_back(e.second); }
+        stencils->offset.push_back(stencils->ids.size());
+    }
+    // vertex-face adjacency for normals
+    stencils->vert_face_offset = vector<int>(st.size()+1,0);
+    for(auto f : quad) for(auto i : range(4)) stencils->vert_face_offset[f[i]+1] ++;
+    for(auto i : range(st.size())) stencils->vert_face_offset[i+1] += stencils->vert_face_offset[i];
+    stencils->vert_faces.resize(quad.size()*4);
+    auto fill = vector<int>(stencils->vert_face_offset.begin(),stencils->vert_face_offset.end()-1);
+    for(auto fi : range(quad.size())) for(auto i : range(4)) stencils->vert_faces[fill[quad[fi][i]]++] = fi;
+    // create display mesh
+    auto display = new Mesh();
+    display->mat = cage->mat;
+    display->quad = quad;
+    display->pos.resize(st.size());
+    display->norm.resize(st.size());
+    if(not cage->texcoord.empty()) {
+        for(auto& s : st) {
+            auto uv = zero2f;
+            for(auto& e : s) uv += cage->texcoord[e.first] * e.second;
+            display->texcoord.push_back(uv);
+        }
+    }
+    cage->_display_mesh = display;
+    cage->_display_stencils = stencils;
+    _update_display_mesh(cage);
+}
+
+void subdivide_update(Scene* scene) {
+    for(auto mesh : scene->meshes) {
+        if(mesh->_display_stencils) _update_display_mesh(mesh);
     }
-    // clear subdivision
-    mesh->subdivision_catmullclark_level = 0;
-    // according to smooth, either smooth_normals or facet_normals
-    if(subdiv->subdivision_catmullclark_smooth) smooth_normals(mesh);
-    else facet_normals(mesh);
-    // copy back
-    *subdiv = *mesh;
-    // clear
-    delete mesh;
+}
+
+// distance of p from the line through a and b
+static float _line_dist(const vec3f& p, const vec3f& a, const vec3f& b) {
+    auto l = length(b-a);
+    if(l == 0) return dist(p,a);
+    return length(cross(p-a,b-a)) / l;
+}
+
+// flatten a cubic bezier segment with de casteljau splits, appending all polyline points after p0
+// uniform: split level times and keep the control polygon of each piece
+// adaptive: split until the control points are within tolerance from the chord (or level is reached)
+static void _flatten_bezier(const vec3f& p0, const vec3f& p1, const vec3f& p2, const vec3f& p3,
+                            int level, bool uniform, float tolerance, vector<vec3f>& points) {
+    auto flat = not uniform and max(_line_dist(p1,p0,p3),_line_dist(p2,p0,p3)) <= tolerance;
+    if(not level or flat) {
+        if(uniform) { points.push_back(p1); points.push_back(p2); }
+        points.push_back(p3);
+        return;
+    }
+    auto q0 = (p0+p1)/2, q1 = (p1+p2)/2, q2 = (p2+p3)/2;
+    auto r0 = (q0+q1)/2, r1 = (q1+q2)/2;
+    auto s = (r0+r1)/2;
+    _flatten_bezier(p0, q0, r0, s, level-1, uniform, tolerance, points);
+    _flatten_bezier(s, r1, q2, p3, level-1, uniform, tolerance, points);
 }
 
 // subdivide bezier spline into line segments (assume bezier has only bezier segments and no lines)
+// segments are flattened in parallel and written as compact polylines that share end points,
+// without keeping the unused control points
 void subdivide_bezier(Mesh* bezier) {
     // skip is needed
     if(not bezier->subdivision_bezier_level) return;
-    // allocate a working polyline from bezier
-    auto lines = new Mesh(*bezier);
-    // foreach level
-    for(auto l : range(bezier->subdivision_bezier_level)) {
-        // make new arrays of positions and bezier segments
-        auto pos = vector<vec3f>();
-        auto segments = vector<vec4i>();
-        // copy all the vertices into the new array (this waste space but it is easier for now)
-        for(auto p : lines->pos) pos.push_back(p);
-        // foreach bezier segment
-        for (auto s : lines->spline) {
-            // apply subdivision algorithm
-            // prepare indices for two new segments
-            auto s0 = vec4i{s.x,0,0,(int)pos.size()};
-            auto s1 = vec4i{(int)pos.size(),0,0,s.w};
-            // add mid point
-            pos.push_back(lines->pos[s.x]*(1.f/8)+lines->pos[s.y]*(3.f/8)+lines->pos[s.z]*(3.f/8)+lines->pos[s.w]*(1.f/8));
-            // add points for first segment and fix segment indices
-            s0.y = pos.size(); s0.z = pos.size()+1;
-            pos.push_back(lines->pos[s.x]*(1.f/2)+lines->pos[s.y]*(1.f/2));
-            pos.push_back(lines->pos[s.x]*(1.f/4)+lines->pos[s.y]*(1.f/2)+lines->pos[s.z]*(1.f/4));
-            // add points for second segment and fix segment indices
-            s1.y = pos.size(); s1.z = pos.size()+1;
-            pos.push_back(lines->pos[s.y]*(1.f/4)+lines->pos[s.z]*(1.f/2)+lines->pos[s.w]*(1.f/4));
-            pos.push_back(lines->pos[s.z]*(1.f/2)+lines->pos[s.w]*(1.f/2));
-            // add indices for both segments into new segments array
-            segments.push_back(s0);
-            segments.push_back(s1);
-        }
-        // set new arrays pos, segments into the working lineset
-        lines->pos = pos;
-        lines->spline = segments;
-    }
-    // copy bezier segments into line segments
-    lines->line.clear();
-    for(auto segment : lines->spline) {
-        lines->line.push_back({segment.x,segment.y});
-        lines->line.push_back({segment.y,segment.z});
-        lines->line.push_back({segment.z,segment.w});
-    }
-    // clear bezier array from lines
-    lines->spline.clear();
-    lines->subdivision_bezier_level = 0;
+    auto nsegments = (int)bezier->spline.size();
+    // flatten each segment independently (interior points only)
+    auto interior = vector<vector<vec3f>>(nsegments);
+    parallel_for(nsegments, [&](int start, int end){
+        for(auto i : range(start,end)) {
+            auto s = bezier->spline[i];
+            _flatten_bezier(bezier->pos[s.x], bezier->pos[s.y], bezier->pos[s.z], bezier->pos[s.w],
+                            bezier->subdivision_bezier_level, bezier->subdivision_bezier_uniform,
+                            bezier->subdivision_bezier_tolerance, interior[i]);
+            interior[i].pop_back();
+        }
+    }, 64);
+    // keep segment end points only, shared between adjacent segments
+    auto pos = vector<vec3f>();
+    auto vid = vector<int>(bezier->pos.size(),-1);
+    for(auto s : bezier->spline) { vid[s.x] = 0; vid[s.w] = 0; }
+    for(auto i : range(bezier->pos.size())) {
+        if(vid[i] < 0) continue;
+        vid[i] = pos.size();
+        pos.push_back(bezier->pos[i]);
+    }
+    // append interior points and connect each polyline
+    auto line = vector<vec2i>();
+    for(auto i : range(nsegments)) {
+        auto s = bezier->spline[i];
+        auto last = vid[s.x];
+        for(auto& p : interior[i]) {
+            line.push_back({last,(int)pos.size()});
+            last = pos.size();
+            pos.push_back(p);
+        }
+        line.push_back({last,vid[s.w]});
+    }
+    // set polylines back and clear bezier array
+    bezier->pos = pos;
+    bezier->line = line;
+    bezier->spline.clear();
+    bezier->subdivision_bezier_level = 0;
     // run smoothing to get proper tangents
-    smooth_tangents(lines);
-    // copy back
-    *bezier = *lines;
-    // clear
-    delete lines;
+    smooth_tangents(bezier);
 }
 
-void subdivide_surface(Surface* surface) {
-    auto mesh    = new Mesh{};
-    mesh->frame  = surface->frame;
-    mesh->mat    = surface->mat;
-    auto radius  = surface->radius;
-    float offset = 0.0;
-    
-    if(surface->isquad) {
-        mesh->pos = { {-radius,-radius,-offset}, {radius,-radius,-offset},
-            {radius,radius,-offset}, {-radius,radius,-offset} };
-        mesh->norm = {z3f,z3f,z3f,z3f};
-        mesh->quad = { {0,1,2,3} };
-    } else {
-        map<pair<int,int>,int> vid;
-        int ci = 1 << (surface->subdivision_level+2);
-        int cj = 1 << (surface->subdivision_level+1);
-        for(auto j : range(cj+1)) {
-            for(auto i : range(ci+1)) {
-                auto u = 2 * pif * i / (float)ci, v = pif * j / (float)cj;
-                auto d = vec3f{cos(u)*sin(v),sin(u)*sin(v),cos(v)};
-                vid[make_pair(i,j)] = mesh->pos.size();
-                mesh->pos.push_back(d*radius*(1-offset));
-                mesh->norm.push_back(d);
-            }
+// unit display meshes shared by all surfaces, indexed by [smooth][subdivision level]
+static vector<Mesh*> _unit_spheres[2];
+static Mesh* _unit_quad = nullptr;
+
+// make a unit sphere with the vertex grid indexed directly as j*(ci+1)+i
+static Mesh* _make_unit_sphere(int level, bool smooth) {
+    auto mesh = new Mesh();
+    int ci = 1 << (level+2);
+    int cj = 1 << (level+1);
+    auto vid = [ci](int i, int j) { return j*(ci+1)+i; };
+    mesh->pos.resize((ci+1)*(cj+1));
+    for(auto j : range(cj+1)) {
+        for(auto i : range(ci+1)) {
+            auto u = 2 * pif * i / (float)ci, v = pif * j / (float)cj;
+            mesh->pos[vid(i,j)] = vec3f{cos(u)*sin(v),sin(u)*sin(v),cos(v)};
         }
-        for(auto j : range(cj)) {
-            for(auto i : range(ci)) {
-                if(j == 0) {
-                    mesh->triangle.push_back({vid[make_pair(i,j)], vid[make_pair(i,j+1)], vid[make_pair(i+1,j+1)]});
-                } else if(j == cj-1) {
-                    mesh->triangle.push_back({vid[make_pair(i,j)], vid[make_pair(i+1,j+1)], vid[make_pair(i+1,j)]});
-                } else {
-                    mesh->quad.push_back({vid[make_pair(i,j)],vid[make_pair(i,j+1)],vid[make_pair(i+1,j+1)],vid[make_pair(i+1,j)]});
-                }
+    }
+    mesh->triangle.reserve(ci*2);
+    mesh->quad.reserve(ci*(cj-2));
+    for(auto j : range(cj)) {
+        for(auto i : range(ci)) {
+            if(j == 0) {
+                mesh->triangle.push_back({vid(i,j), vid(i,j+1), vid(i+1,j+1)});
+            } else if(j == cj-1) {
+                mesh->triangle.push_back({vid(i,j), vid(i+1,j+1), vid(i+1,j)});
+            } else {
+                mesh->quad.push_back({vid(i,j),vid(i,j+1),vid(i+1,j+1),vid(i+1,j)});
             }
         }
     }
-    
-    if(surface->subdivision_smooth) smooth_normals(mesh);
+    // the normals of a unit sphere are its positions
+    if(smooth) mesh->norm = mesh->pos;
     else facet_normals(mesh);
-    
-    surface->_display_mesh = mesh;
+    return mesh;
+}
+
+// display meshes are unit size and shared: they are drawn with the surface frame, radius and material
+void subdivide_surface(Surface* surface) {
+    if(surface->isquad) {
+        if(not _unit_quad) {
+            _unit_quad = new Mesh();
+            _unit_quad->pos = { {-1,-1,0}, {1,-1,0}, {1,1,0}, {-1,1,0} };
+            _unit_quad->norm = {z3f,z3f,z3f,z3f};
+            _unit_quad->quad = { {0,1,2,3} };
+        }
+        surface->_display_mesh = _unit_quad;
+    } else {
+        auto& cache = _unit_spheres[(surface->subdivision_smooth) ? 1 : 0];
+        if((int)cache.size() <= surface->subdivision_level) cache.resize(surface->subdivision_level+1,nullptr);
+        if(not cache[surface->subdivision_level])
+            cache[surface->subdivision_level] = _make_unit_sphere(surface->subdivision_level, surface->subdivision_smooth);
+        surface->_display_mesh = cache[surface->subdivision_level];
+    }
+}
+
+// cache key of the subdivision of a mesh: cage arrays and subdivision parameters
+// (and the view for adaptive subdivision, which depends on it)
+static uint64_t _subdivision_key(Mesh* mesh, Camera* camera) {
+    auto h = hash_value((int)BINARY_VERSION, hash_bytes("subdivision", 11));
+    h = hash_array(mesh->pos, h); h = hash_array(mesh->norm, h); h = hash_array(mesh->texcoord, h);
+    h = hash_array(mesh->triangle, h); h = hash_array(mesh->quad, h); h = hash_array(mesh->point, h);
+    h = hash_array(mesh->line, h); h = hash_array(mesh->spline, h);
+    h = hash_value(mesh->subdivision_catmullclark_level, h);
+    h = hash_value(mesh->subdivision_catmullclark_smooth, h);
+    h = hash_value(mesh->subdivision_bezier_level, h);
+    h = hash_value(mesh->subdivision_bezier_uniform, h);
+    h = hash_value(mesh->subdivision_bezier_tolerance, h);
+    h = hash_value(mesh->skinning or mesh->simulation, h);
+    if(mesh->subdivision_catmullclark_adaptive) {
+        h = hash_value(mesh->subdivision_catmullclark_adaptive_angle, h);
+        h = hash_value(mesh->subdivision_catmullclark_adaptive_area, h);
+        h = hash_value(mesh->frame, h);
+        h = hash_value(camera != nullptr, h);
+        if(camera) h = hash_value(*camera, h);
+    }
+    return h;
+}
+
+// store the result of subdivide: the display mesh and its stencils for deforming meshes,
+// the subdivided arrays otherwise
+static void _save_subdivision(Mesh* mesh, const string& filename) {
+    auto bin = BinaryWriter();
+    if(mesh->_display_stencils) {
+        auto st = mesh->_display_stencils;
+        bin.add<int,4>("quad", mesh->_display_mesh->quad);
+        bin.add<float,2>("texcoord", mesh->_display_mesh->texcoord);
+        bin.add<int,1>("stencils.cage_size", vector<int>(1,st->cage_size));
+        bin.add<int,1>("stencils.offset", st->offset);
+        bin.add<int,1>("stencils.ids", st->ids);
+        bin.add<float,1>("stencils.weights", st->weights);
+        bin.add<int,1>("stencils.vert_face_offset", st->vert_face_offset);
+        bin.add<int,1>("stencils.vert_faces", st->vert_faces);
+    } else {
+        bin.add<float,3>("pos", mesh->pos);
+        bin.add<float,3>("norm", mesh->norm);
+        bin.add<float,2>("texcoord", mesh->texcoord);
+        bin.add<int,3>("triangle", mesh->triangle);
+        bin.add<int,4>("quad", mesh->quad);
+        bin.add<int,1>("point", mesh->point);
+        bin.add<int,2>("line", mesh->line);
+        bin.add<int,4>("spline", mesh->spline);
+    }
+    auto tmpname = asset_cache_tmpname(filename);
+    bin.save(tmpname);
+    asset_cache_commit(tmpname, filename);
+}
+
+// restore the result of subdivide saved by _save_subdivision
+static void _load_subdivision(Mesh* mesh, const string& filename) {
+    auto bin = BinaryFile(filename);
+    if(bin.has_section("stencils.offset")) {
+        auto display = new Mesh();
+        auto st = new SubdivisionStencils();
+        auto cage_size = vector<int>();
+        display->mat = mesh->mat;
+        bin.read<int,4>("quad", display->quad);
+        bin.read<float,2>("texcoord", display->texcoord);
+        bin.read<int,1>("stencils.cage_size", cage_size);
+        st->cage_size = cage_size.at(0);
+        bin.read<int,1>("stencils.offset", st->offset);
+        bin.read<int,1>("stencils.ids", st->ids);
+        bin.read<float,1>("stencils.weights", st->weights);
+        bin.read<int,1>("stencils.vert_face_offset", st->vert_face_offset);
+        bin.read<int,1>("stencils.vert_faces", st->vert_faces);
+        display->pos.resize(st->size());
+        display->norm.resize(st->size());
+        mesh->_display_mesh = display;
+        mesh->_display_stencils = st;
+        _update_display_mesh(mesh);
+    } else {
+        mesh->pos.clear(); mesh->norm.clear(); mesh->texcoord.clear(); mesh->triangle.clear();
+        mesh->quad.clear(); mesh->point.clear(); mesh->line.clear(); mesh->spline.clear();
+        bin.read<float,3>("pos", mesh->pos);
+        bin.read<float,3>("norm", mesh->norm);
+        bin.read<float,2>("texcoord", mesh->texcoord);
+        bin.read<int,3>("triangle", mesh->triangle);
+        bin.read<int,4>("quad", mesh->quad);
+        bin.read<int,1>("point", mesh->point);
+        bin.read<int,2>("line", mesh->line);
+        bin.read<int,4>("spline", mesh->spline);
+        mesh->subdivision_catmullclark_level = 0;
+        mesh->subdivision_bezier_level = 0;
+    }
+}
+
+void subdivide(Mesh* mesh, Camera* camera) {
+    if(not mesh->subdivision_catmullclark_level and not mesh->subdivision_bezier_level) return;
+    // reuse a previous subdivision of the same inputs if cached (inputs are hashed only if caching)
+    auto cachename = (asset_cache_enabled()) ? asset_cache_filename(_subdivision_key(mesh, camera), "subdiv.bin") : string();
+    if(not cachename.empty() and asset_cache_contains(cachename)) { _load_subdivision(mesh, cachename); return; }
+    // deforming meshes keep their control cage and are re-subdivided each frame
+    if(mesh->subdivision_catmullclark_level and (mesh->skinning or mesh->simulation)) subdivide_catmullclark_stencils(mesh);
+    else if(mesh->subdivision_catmullclark_level and mesh->subdivision_catmullclark_adaptive) subdivide_catmullclark_adaptive(mesh, camera);
+    else if(mesh->subdivision_catmullclark_level) subdivide_catmullclark(mesh);
+    if(mesh->subdivision_bezier_level) subdivide_bezier(mesh);
+    if(not cachename.empty()) _save_subdivision(mesh, cachename);
 }
 
 void subdivide(Scene* scene) {
     for(auto mesh : scene->meshes) {
-        if(mesh->subdivision_catmullclark_level) subdivide_catmullclark(mesh);
-        if(mesh->subdivision_bezier_level) subdivide_bezier(mesh);
+        subdivide(mesh, scene->camera);
     }
     for(auto surface : scene->surfaces) {
         subdivide_surface(surface);
@@ -9,7 +9,7 @@ struct EdgeMap {
     vector<vec2i>           _edge_list; // internal list to generate unique ids
     
     // create an edge map for a collection of triangles and quads
-    EdgeMap(vector<vec3i> triangle, vector<vec4i> quad) {
+    EdgeMap(const vector<vec3i>& triangle, const vector<vec4i>& quad) {
         for(auto f : triangle) { _add_edge(f.x,f.y); _add_edge(f.y,f.z); _add_edge(f.z,f.x); }
         for(auto f : quad) { _add_edge(f.x,f.y); _add_edge(f.y,f.z); _add_edge(f.z,f.w); _add_edge(f.w,f.x); }
     }
@@ -33,6 +33,21 @@ struct EdgeMap {
     }
 };
 
+// subdivision stencils: each refined vertex is a fixed weighted sum of control cage vertices,
+// so a deforming cage can be re-subdivided every frame without rebuilding the topology
+// stencils are stored as compressed rows: stencil i uses ids/weights in [offset[i],offset[i+1])
+struct SubdivisionStencils {
+    int             cage_size = 0;      // number of control cage vertices
+    vector<int>     offset;             // start of each stencil (number of refined vertices + 1)
+    vector<int>     ids;                // control vertex ids
+    vector<float>   weights;            // control vertex weights
+    vector<int>     vert_face_offset;   // start of the faces adjacent to each refined vertex
+    vector<int>     vert_faces;         // faces adjacent to each refined vertex (used for normals)
+    
+    // number of refined vertices
+    int size() const { return (int)offset.size()-1; }
+};
+
 // set face normals (duplicating vertices)
 void facet_normals(Mesh* mesh);
 
@@ -42,13 +57,33 @@ void smooth_normals(Mesh* mesh);
 // compute smoothed line tangents
 void smooth_tangents(Mesh* lines);
 
+// split quads into triangles
+vector<vec3i> triangulate_quads(const vector<vec4i>& quad);
+
+// reorder triangles so that consecutive ones reuse the vertices in the post-transform
+// vertex cache (of cache_size entries); winding is preserved
+vector<vec3i> optimize_triangle_order(const vector<vec3i>& triangle, int cache_size = 16);
+
 // subdivide the scene
 void subdivide(Scene* scene);
 
+// subdivide a mesh (camera is used by adaptive subdivision)
+void subdivide(Mesh* mesh, Camera* camera);
+
 // apply catmull-clark subdivision to the mesh recursively
 void subdivide_catmullclark(Mesh* subdiv);
 
-// apply bezier spline subdivision
+// apply catmull-clark subdivision only to faces with high curvature, near extraordinary vertices
+// or covering a large area of the camera image; transition faces are split to avoid cracks
+void subdivide_catmullclark_adaptive(Mesh* subdiv, Camera* camera);
+
+// build a display mesh for a deforming control cage with cached catmull-clark stencils
+void subdivide_catmullclark_stencils(Mesh* cage);
+
+// evaluate cached stencils to update the display meshes of deforming control cages
+void subdivide_update(Scene* scene);
+
+// apply bezier spline subdivision, either uniform or adaptive within a flatness tolerance
 void subdivide_bezier(Mesh* splines);
 
 // make display meshes for surfaces